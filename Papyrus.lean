@@ -1,7 +1,15 @@
 import Papyrus.Init
+import Papyrus.Instrumentation
+import Papyrus.Counters
 import Papyrus.Context
 import Papyrus.MemoryBufferRef
 import Papyrus.ExecutionEngineRef
+import Papyrus.Transforms
+import Papyrus.Rewrite
+import Papyrus.Remarks
+import Papyrus.TargetMachineRef
+import Papyrus.DataLayout
+import Papyrus.MachineCode
 import Papyrus.GenericValueRef
 import Papyrus.IR
 import Papyrus.Builders
@@ -1,4 +1,5 @@
 import Papyrus.Context
+import Papyrus.Instrumentation
 import Papyrus.IR.ModuleRef
 import Papyrus.IR.FunctionRef
 import Papyrus.IR.GlobalVariableRef
@@ -30,10 +31,11 @@ protected def BasicBlockM.runIn (ctx : BasicBlockContext) (self : BasicBlockM α
 
 namespace Builder
 
-def module (name : String) (builder : ModuleM PUnit) : LlvmM ModuleRef := do
-  let modRef ← ModuleRef.new name
-  builder.runIn modRef
-  return modRef
+def module (name : String) (builder : ModuleM PUnit) : LlvmM ModuleRef :=
+  withPhase Phase.construct (detail := name) do
+    let modRef ← ModuleRef.new name
+    builder.runIn modRef
+    return modRef
 
 -- ## Module Builder Actions
 
@@ -0,0 +1,90 @@
+import Papyrus.IR.ModuleRef
+
+namespace Papyrus
+
+/--
+  A kind of external object held by Papyrus.
+  Each kind corresponds to a kind of Papyrus reference.
+-/
+inductive ObjectKind
+| /-- Objects not otherwise categorized. -/ other
+| /-- `ContextRef` -/ context
+| /-- `MemoryBufferRef` -/ memoryBuffer
+| /-- `ModuleRef` -/ module
+| /-- `TypeRef` and its specializations. -/ type
+| /-- `ValueRef` and its specializations. -/ value
+| /-- `GenericValueRef` -/ genericValue
+| /-- `ExecutionEngineRef` -/ executionEngine
+deriving BEq, DecidableEq, Repr
+
+attribute [unbox] ObjectKind
+instance : Inhabited ObjectKind := ⟨ObjectKind.other⟩
+
+namespace ObjectKind
+
+/-- All object kinds in the order Papyrus reports them. -/
+def all : Array ObjectKind :=
+  #[other, context, memoryBuffer, module, type, value, genericValue, executionEngine]
+
+end ObjectKind
+
+/-- The counts of a kind of external object. -/
+structure ObjectCount where
+  /-- The number of objects currently alive (i.e., not yet garbage collected). -/
+  live : UInt64
+  /-- The number of objects ever allocated. -/
+  allocated : UInt64
+  deriving Inhabited, Repr
+
+/-- The memory in use by the process and its JIT compiled code. -/
+structure MemoryUsage where
+  /--
+    The bytes in use by the process' allocator
+    (including those of LLVM contexts and modules).
+  -/
+  mallocBytes : UInt64
+  /-- The bytes allocated for the code sections of JIT compiled modules. -/
+  jitCodeBytes : UInt64
+  /-- The bytes allocated for the data sections of JIT compiled modules. -/
+  jitDataBytes : UInt64
+  deriving Inhabited, Repr
+
+/-- A snapshot of Papyrus' counters. -/
+structure CountersSnapshot where
+  /-- The counts of each kind of external object. -/
+  objects : Array (ObjectKind × ObjectCount)
+  /-- The number of LLVM modules ever created (or parsed). -/
+  modulesCreated : UInt64
+  /-- The memory in use. -/
+  memory : MemoryUsage
+  /-- The sizes of the requested modules (by module ID). -/
+  modules : Array (String × ModuleStats)
+  deriving Inhabited, Repr
+
+namespace Counters
+
+/-- Get the counts of each kind of external object (indexed as in `ObjectKind.all`). -/
+@[extern "papyrus_counters_get_object_counts"]
+constant getObjectCounts : IO (Array ObjectCount)
+
+/-- Get the number of LLVM modules ever created (or parsed) by Papyrus. -/
+@[extern "papyrus_counters_get_modules_created"]
+constant getModulesCreated : IO UInt64
+
+/-- Get the memory currently in use. -/
+@[extern "papyrus_counters_get_memory_usage"]
+constant getMemoryUsage : IO MemoryUsage
+
+/-- Take a snapshot of Papyrus' counters and the sizes of the given modules. -/
+def snapshot (mods : Array ModuleRef := #[]) : IO CountersSnapshot := do
+  let counts ← getObjectCounts
+  let modules ← mods.mapM fun mod => do
+    return (← mod.getModuleID, ← mod.getStats)
+  return {
+    objects := ObjectKind.all.zip counts
+    modulesCreated := ← getModulesCreated
+    memory := ← getMemoryUsage
+    modules
+  }
+
+end Counters
@@ -0,0 +1,81 @@
+import Papyrus.IR.TypeRef
+import Papyrus.IR.ModuleRef
+import Papyrus.TargetMachineRef
+
+namespace Papyrus
+
+/-- The size and alignment of a type under a data layout. -/
+structure TypeLayout where
+  /-- The size of the type (in bits). -/
+  sizeInBits : UInt64
+  /-- The maximum number of bytes a store of the type may overwrite. -/
+  storeSize : UInt64
+  /-- The offset (in bytes) between successive values of the type in memory. -/
+  allocSize : UInt64
+  /-- The minimum alignment of the type required by the ABI (in bytes). -/
+  abiAlign : UInt64
+  /-- The preferred alignment of the type (in bytes). -/
+  prefAlign : UInt64
+  deriving Inhabited, Repr
+
+/-- The layout of a struct type under a data layout. -/
+structure StructLayout where
+  /-- The offset (in bytes) of each field of the struct. -/
+  fieldOffsets : Array Nat
+  /-- The size of the struct (in bytes). -/
+  size : UInt64
+  /-- The alignment of the struct (in bytes). -/
+  align : UInt64
+  deriving Inhabited, Repr
+
+namespace ModuleRef
+
+/-- Get the target triple of this module. -/
+@[extern "papyrus_module_get_target_triple"]
+constant getTargetTriple (self : @& ModuleRef) : IO String
+
+/--
+  Set the target triple of this module.
+  By default (i.e., for an empty triple), it is set to the host's triple.
+-/
+@[extern "papyrus_module_set_target_triple"]
+constant setTargetTriple (self : @& ModuleRef) (triple : @& String := "") : IO PUnit
+
+/-- Get the string representation of the data layout of this module. -/
+@[extern "papyrus_module_get_data_layout"]
+constant getDataLayout (self : @& ModuleRef) : IO String
+
+/--
+  Set the data layout of this module from its string representation.
+  By default (i.e., for an empty string), it is set to the host's data layout,
+  which requires the native target to be initialized (see `initNativeTarget`).
+-/
+@[extern "papyrus_module_set_data_layout"]
+constant setDataLayout (self : @& ModuleRef) (layout : @& String := "") : IO PUnit
+
+/-- Set the target triple and data layout of this module to the host's. -/
+def setHostTarget (self : @& ModuleRef) : IO PUnit := do
+  self.setTargetTriple
+  self.setDataLayout
+
+/-- Set the target triple and data layout of this module to the given target's. -/
+@[extern "papyrus_module_set_target"]
+constant setTarget (self : @& ModuleRef) (tm : @& TargetMachineRef) : IO PUnit
+
+/--
+  Get the layout of each of the given (sized) types
+  under the data layout of this module.
+-/
+@[extern "papyrus_module_get_type_layouts"]
+constant getTypeLayouts (types : @& Array TypeRef) (self : @& ModuleRef)
+  : IO (Array TypeLayout)
+
+/--
+  Get the layout of each of the given (non-opaque) struct types
+  under the data layout of this module.
+-/
+@[extern "papyrus_module_get_struct_layouts"]
+constant getStructLayouts (types : @& Array TypeRef) (self : @& ModuleRef)
+  : IO (Array StructLayout)
+
+end ModuleRef
@@ -66,12 +66,71 @@ constant ExecutionEngineRef : Type := Unit
 
 namespace ExecutionEngineRef
 
-/-- Create an execution engine for the given module. -/
+/--
+  Create an execution engine for the given module.
+
+  If `shareFunctions` is set (and the engine is a JIT), the engine shares
+  compiled functions with other such engines. If definitions in the module
+  have bodies matching a function another live engine already compiled,
+  the engine compiles a private copy of the module in which they are
+  declarations bound to that code (so they are not compiled again),
+  leaving the module itself untouched. The functions this engine compiles
+  are offered to engines created later.
+  An engine keeps the engines whose code it uses alive.
+
+  Functions are matched with LLVM's `FunctionComparator`, which tells globals
+  apart by identity, so only functions that reference no other global values
+  (e.g., self-contained helpers) are shared.
+-/
 @[extern "papyrus_execution_engine_create_for_module"]
 constant createForModule (mod : @& ModuleRef) (kind : @& EngineKind := EngineKind.either)
   (march : @& String := "") (mcpu : @& String := "") (mattrs : @& Array String := #[])
   (optLevel : @& OptLevel := OptLevel.default) (verifyModule := false)
-  : IO ExecutionEngineRef
+  (shareFunctions := false) : IO ExecutionEngineRef
+
+/--
+  Get the number of function definitions this engine replaced
+  with code compiled by other engines (see `createForModule`).
+-/
+@[extern "papyrus_execution_engine_get_num_reused_functions"]
+constant getNumReusedFunctions (self : @& ExecutionEngineRef) : IO UInt64
+
+/--
+  Add a module to the engine.
+  Its code is generated when the engine is next finalized
+  (e.g., by `finalizeObject` or by running one of its functions).
+-/
+@[extern "papyrus_execution_engine_add_module"]
+constant addModule (mod : @& ModuleRef) (self : @& ExecutionEngineRef) : IO PUnit
+
+/--
+  Remove a module from the engine.
+
+  The code already generated for the module stays loaded (MCJIT cannot
+  unload code), but its functions can be redefined by modules added later.
+-/
+@[extern "papyrus_execution_engine_remove_module"]
+constant removeModule (mod : @& ModuleRef) (self : @& ExecutionEngineRef) : IO PUnit
+
+/--
+  Replace a module of the engine with a new one and generate its code.
+  Only the new module (and any other modules yet to be compiled) is compiled.
+
+  Functions of the new module take precedence over those of the same name
+  in the old one. However, code in other modules that was already compiled
+  keeps calling the old definitions.
+-/
+@[extern "papyrus_execution_engine_replace_module"]
+constant replaceModule (oldMod : @& ModuleRef) (newMod : @& ModuleRef)
+  (self : @& ExecutionEngineRef) : IO PUnit
+
+/-- Generate code for (and relocate) any modules the engine has yet to compile. -/
+@[extern "papyrus_execution_engine_finalize_object"]
+constant finalizeObject (self : @& ExecutionEngineRef) : IO PUnit
+
+/-- Get the number of modules in the engine. -/
+@[extern "papyrus_execution_engine_get_num_modules"]
+constant getNumModules (self : @& ExecutionEngineRef) : IO Nat
 
 /--
   Execute the given function with the given arguments, and return the result.
@@ -94,3 +153,102 @@ constant runFunctionAsMain (fn : @& FunctionRef) (self : @& ExecutionEngineRef)
   (args : @& Array String := #[]) (env : @& Array String := #[]) : IO UInt32
 
 end ExecutionEngineRef
+
+/-!
+  # JIT Session
+
+  A process-wide JIT that outlives individual `LlvmM` contexts
+  (e.g., the commands of a file being elaborated).
+
+  The session copies modules into a fresh context (through bitcode) to run
+  them and keeps the object code of the most recently run ones. Running
+  a module whose bitcode matches one it has already compiled reuses the
+  compiled code. The native target is initialized once, when the session
+  is first used.
+-/
+
+namespace JitSession
+
+/--
+  Run the `main` function of a module in the JIT session
+  (see `ExecutionEngineRef.runFunctionAsMain`) and return its exit code.
+  The module is only compiled if the session has not compiled it before.
+
+  Each run loads the module's code into a fresh engine,
+  so it starts from the initial values of the module's global variables.
+-/
+@[extern "papyrus_jit_session_run_main"]
+constant runMain (mod : @& ModuleRef)
+  (args : @& Array String := #[]) (env : @& Array String := #[]) : IO UInt32
+
+/-- Get the number of compiled modules the session holds. -/
+@[extern "papyrus_jit_session_get_num_modules"]
+constant getNumModules : IO Nat
+
+/-- Discard the compiled modules of the session. -/
+@[extern "papyrus_jit_session_clear"]
+constant clear : IO PUnit
+
+end JitSession
+
+/-!
+  # Tiered Execution
+-/
+
+/-- An opaque type representing a Papyrus tiered execution engine. -/
+constant TieredEngine : Type := Unit
+
+/--
+  A reference to a tiered execution engine.
+
+  A tiered engine starts running a module immediately in a cheap base tier
+  (the interpreter or an unoptimized JIT) and counts the calls made to each
+  function. Once some function has been called `threshold` times, a copy of
+  the module is optimized with LLVM's standard pipeline and compiled with an
+  optimizing JIT on a background thread. Once that finishes, calls run the
+  optimized code.
+
+  The whole module is optimized at once, so calls between its functions
+  also run optimized code. Calls that MCJIT cannot make (see `runFunction`)
+  and functions optimized away (e.g., internal ones that were inlined)
+  keep running in the base tier.
+
+  Only code is duplicated: the optimized copy uses the base tier's global
+  variables, so state written before the tier-up carries over. Modules with
+  mutable globals the tiers cannot share (thread-local ones, and internal
+  ones if the base tier is a JIT) are not optimized, and `wait` reports why.
+-/
+def TieredEngineRef := OwnedPtr TieredEngine
+
+namespace TieredEngineRef
+
+/--
+  Create a tiered execution engine for the given module.
+  The base tier is the interpreter if `interpret` is set
+  and an unoptimized JIT otherwise.
+-/
+@[extern "papyrus_tiered_engine_create"]
+constant create (mod : @& ModuleRef) (interpret := true) (threshold : UInt32 := 100)
+  (optLevel : @& OptLevel := OptLevel.aggressive) : IO TieredEngineRef
+
+/-- Execute the given function with the given arguments, and return the result. -/
+@[extern "papyrus_tiered_engine_run_function"]
+constant runFunction (fn : @& FunctionRef) (self : @& TieredEngineRef)
+  (args : @& Array GenericValueRef := #[]) : IO GenericValueRef
+
+/-- Get the number of calls of the given function run in the base tier. -/
+@[extern "papyrus_tiered_engine_get_call_count"]
+constant getCallCount (fn : @& FunctionRef) (self : @& TieredEngineRef) : IO UInt64
+
+/-- Get whether the optimized tier is ready. -/
+@[extern "papyrus_tiered_engine_is_optimized"]
+constant isOptimized (self : @& TieredEngineRef) : IO Bool
+
+/--
+  Wait for the optimized tier to finish compiling (if it has started).
+  Throws an error if its compilation failed (or could not start).
+-/
+@[extern "papyrus_tiered_engine_wait"]
+constant wait (self : @& TieredEngineRef) : IO PUnit
+
+end TieredEngineRef
@@ -19,3 +19,4 @@ import Papyrus.IR.GlobalModifiers
 import Papyrus.IR.FunctionRef
 import Papyrus.IR.GlobalVariableRef
 import Papyrus.IR.ModuleRef
+import Papyrus.IR.Verifier
@@ -30,3 +30,57 @@ constant getInstructions (self : @& BasicBlockRef) : IO (Array InstructionRef)
 /-- Add an instruction to the end of the basic block. -/
 @[extern "papyrus_basic_block_append_instruction"]
 constant appendInstruction (inst : @& InstructionRef) (self : @& BasicBlockRef) : IO PUnit
+
+/-- Get the terminator instruction of this basic block (if it has one). -/
+@[extern "papyrus_basic_block_get_terminator"]
+constant getTerminator? (self : @& BasicBlockRef) : IO (Option InstructionRef)
+
+/--
+  Split this basic block in two at the given instruction.
+  The instruction and those after it are moved into a new block
+  (inserted after this one), which this block unconditionally branches to.
+  The block must have a terminator. Returns the new block.
+-/
+@[extern "papyrus_basic_block_split"]
+constant split (inst : @& InstructionRef) (name : @& String := "")
+  (self : @& BasicBlockRef) : IO BasicBlockRef
+
+/--
+  Move this basic block (which may be unlinked) right before the given one,
+  which may be in another function.
+-/
+@[extern "papyrus_basic_block_move_before"]
+constant moveBefore (self : @& BasicBlockRef) (pos : @& BasicBlockRef) : IO PUnit
+
+/--
+  Move this basic block (which may be unlinked) right after the given one,
+  which may be in another function.
+-/
+@[extern "papyrus_basic_block_move_after"]
+constant moveAfter (self : @& BasicBlockRef) (pos : @& BasicBlockRef) : IO PUnit
+
+/--
+  Unlink this basic block from its function without deleting it,
+  so that it can be inserted elsewhere.
+-/
+@[extern "papyrus_basic_block_remove_from_parent"]
+constant removeFromParent (self : @& BasicBlockRef) : IO PUnit
+
+/--
+  Unlink this basic block (which no branch may target) from its function
+  and delete it along with its instructions, which may only be used
+  within the block. Any references to them become invalid.
+  The block's incoming entries in the PHIs of its successors are removed.
+-/
+@[extern "papyrus_basic_block_erase_from_parent"]
+constant eraseFromParent (self : @& BasicBlockRef) : IO PUnit
+
+end BasicBlockRef
+
+namespace InstructionRef
+
+/-- Get the basic block containing this instruction (if any). -/
+@[extern "papyrus_instruction_get_parent"]
+constant getParent? (self : @& InstructionRef) : IO (Option BasicBlockRef)
+
+end InstructionRef
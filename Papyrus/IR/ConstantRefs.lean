@@ -122,6 +122,38 @@ constant getConstantInt (value : @& Int) (self : @& IntegerTypeRef) : IO Constan
 @[extern "papyrus_get_constant_nat_of_type"]
 constant getConstantNat (value : @& Nat) (self : @& IntegerTypeRef) : IO ConstantIntRef
 
+/--
+  Get references to constants of this type with the given `Nat` values
+  (in a single call). Each value is truncated and/or extended as necessary.
+-/
+@[extern "papyrus_get_constant_nats_of_type"]
+constant getConstantNats (values : @& Array Nat) (self : @& IntegerTypeRef)
+  : IO (Array ConstantIntRef)
+
+/--
+  Get references to constants of this type with the given `Int` values
+  (in a single call). Each value is truncated and/or extended as necessary.
+-/
+@[extern "papyrus_get_constant_ints_of_type"]
+constant getConstantInts (values : @& Array Int) (self : @& IntegerTypeRef)
+  : IO (Array ConstantIntRef)
+
+/--
+  Get a reference to a constant array with elements of this type
+  holding the given `Nat` values (e.g., a table of wide integers).
+-/
+@[extern "papyrus_get_constant_array_of_nats"]
+constant getConstantArrayOfNats (values : @& Array Nat) (self : @& IntegerTypeRef)
+  : IO ConstantRef
+
+/--
+  Get a reference to a constant array with elements of this type
+  holding the given `Int` values (e.g., a table of wide integers).
+-/
+@[extern "papyrus_get_constant_array_of_ints"]
+constant getConstantArrayOfInts (values : @& Array Int) (self : @& IntegerTypeRef)
+  : IO ConstantRef
+
 end IntegerTypeRef
 
 --------------------------------------------------------------------------------
@@ -130,7 +162,10 @@ end IntegerTypeRef
 
 /--
   A reference to an external LLVM
-  [ConstantDataSequential](https://llvm.org/doxygen/classllvm_1_1ConstantDataSequential.html).
+  [ConstantDataSequential](https://llvm.org/doxygen/classllvm_1_1ConstantDataSequential.html)
+  or to a zero aggregate of an array or vector type,
+  which LLVM uses in place of constant data whose bytes are all zero.
+  Its operations fail on any other kind of constant.
 -/
 structure ConstantDataSequentialRef extends ConstantDataRef
 instance : Coe ConstantDataSequentialRef ConstantDataRef := ⟨(·.toConstantDataRef)⟩
@@ -145,6 +180,46 @@ constant isString (const : @& ConstantDataSequentialRef) : IO Bool
 @[extern "papyrus_constant_data_sequential_get_as_string"]
 constant getAsString (const : @& ConstantDataSequentialRef) : IO String
 
+/-- Get the number of elements in this constant. -/
+@[extern "papyrus_constant_data_sequential_get_num_elements"]
+constant getNumElements (const : @& ConstantDataSequentialRef) : IO UInt64
+
+/-- Get the raw bytes of the elements of this constant (in host byte order). -/
+@[extern "papyrus_constant_data_sequential_get_raw_data"]
+constant getRawData (const : @& ConstantDataSequentialRef) : IO ByteArray
+
+/--
+  Get a reference to a constant data array (or vector, if `isVector`)
+  with elements of the given type read from raw bytes (in host byte order).
+
+  Elements may be 8, 16, 32, or 64-bit integers or
+  `half`, `bfloat`, `float`, or `double` floating point values.
+  The result is a zero aggregate if every byte is zero.
+-/
+@[extern "papyrus_get_constant_data_of_bytes"]
+constant ofBytes (bytes : @& ByteArray) (elemType : @& TypeRef)
+  (isVector := false) : IO ConstantRef
+
+/--
+  Get a reference to a constant data array (or vector, if `isVector`)
+  of `double`s (or `float`s, if `single`) with the values of the given array.
+-/
+@[extern "papyrus_get_constant_data_of_float_array"]
+constant ofFloatArray (floats : @& FloatArray) (single := false)
+  (isVector := false) : LlvmM ConstantRef
+
+/-- Get a reference to a constant data array (or vector) of `i16`s. -/
+@[extern "papyrus_get_constant_data_of_uint16_array"]
+constant ofUInt16Array (values : @& Array UInt16) (isVector := false) : LlvmM ConstantRef
+
+/-- Get a reference to a constant data array (or vector) of `i32`s. -/
+@[extern "papyrus_get_constant_data_of_uint32_array"]
+constant ofUInt32Array (values : @& Array UInt32) (isVector := false) : LlvmM ConstantRef
+
+/-- Get a reference to a constant data array (or vector) of `i64`s. -/
+@[extern "papyrus_get_constant_data_of_uint64_array"]
+constant ofUInt64Array (values : @& Array UInt64) (isVector := false) : LlvmM ConstantRef
+
 end ConstantDataSequentialRef
 
 /--
@@ -27,3 +27,31 @@ def opcode (self : InstructionRef) : UInt32 :=
 /-- The kind of this instruction. -/
 def instructionKind (self : InstructionRef) : InstructionKind :=
   InstructionKind.ofOpcode! self.opcode
+
+-- ## Placement
+
+/--
+  Move this instruction (which may be unlinked) right before the given one.
+-/
+@[extern "papyrus_instruction_move_before"]
+constant moveBefore (self : @& InstructionRef) (pos : @& InstructionRef) : IO PUnit
+
+/--
+  Move this instruction (which may be unlinked) right after the given one.
+-/
+@[extern "papyrus_instruction_move_after"]
+constant moveAfter (self : @& InstructionRef) (pos : @& InstructionRef) : IO PUnit
+
+/--
+  Unlink this instruction from its basic block without deleting it,
+  so that it can be inserted elsewhere.
+-/
+@[extern "papyrus_instruction_remove_from_parent"]
+constant removeFromParent (self : @& InstructionRef) : IO PUnit
+
+/--
+  Unlink this instruction (which must have no uses) from its basic block
+  and delete it. Any references to the instruction become invalid.
+-/
+@[extern "papyrus_instruction_erase_from_parent"]
+constant eraseFromParent (self : @& InstructionRef) : IO PUnit
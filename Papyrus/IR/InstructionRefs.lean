@@ -163,6 +163,30 @@ constant setSuccessor (bb : @& BasicBlockRef) (self : @& BrInstRef) : IO PUnit
 
 end BrInstRef
 
+--------------------------------------------------------------------------------
+-- # Binary Operators
+--------------------------------------------------------------------------------
+
+/--
+  A reference to an external LLVM
+  [BinaryOperator](https://llvm.org/doxygen/classllvm_1_1BinaryOperator.html)
+  (e.g., `add`, `fmul`, or `xor`).
+-/
+structure BinaryOperatorRef extends InstructionRef
+instance : Coe BinaryOperatorRef InstructionRef := ⟨(·.toInstructionRef)⟩
+
+namespace BinaryOperatorRef
+
+/--
+  Create a new unlinked binary operator of the given kind.
+  Both operands must have the same (integer or floating point) type.
+-/
+@[extern "papyrus_binary_operator_create"]
+constant create (kind : InstructionKind) (lhs rhs : @& ValueRef)
+  (name : @& String := "") : IO BinaryOperatorRef
+
+end BinaryOperatorRef
+
 --------------------------------------------------------------------------------
 -- # Load
 --------------------------------------------------------------------------------
@@ -18,6 +18,14 @@ constant Llvm.Module : Type := Unit
 -/
 def ModuleRef := LinkedLoosePtr ContextRef Llvm.Module
 
+/-- The sizes of a module. -/
+structure ModuleStats where
+  functions : UInt64
+  globalVariables : UInt64
+  basicBlocks : UInt64
+  instructions : UInt64
+  deriving Inhabited, Repr
+
 namespace ModuleRef
 
 /-- Create a new module. -/
@@ -32,6 +40,24 @@ constant parseBitcodeFromBuffer (self : @& MemoryBufferRef) : LlvmM ModuleRef
 def parseBitcodeFromFile (file : System.FilePath) : LlvmM ModuleRef := do
   parseBitcodeFromBuffer (← MemoryBufferRef.fromFile file)
 
+/--
+  Load a module from bitcode in a `ByteArray`
+  (e.g., one produced by `writeBitcodeToByteArray`).
+  The `name` is used to identify the buffer in error messages.
+-/
+@[extern "papyrus_module_parse_bitcode_from_byte_array"]
+constant parseBitcodeFromByteArray (bytes : @& ByteArray) (name : @& String := "")
+  : LlvmM ModuleRef
+
+/--
+  Load a module from bitcode encoded as a string of hexadecimal digits
+  (two per byte), e.g., one embedded by `llvm bitcode module`.
+  The `name` is used to identify the buffer in error messages.
+-/
+@[extern "papyrus_module_parse_bitcode_from_hex"]
+constant parseBitcodeFromHex (hex : @& String) (name : @& String := "")
+  : LlvmM ModuleRef
+
 /--
   Write the bitcode of the module to a file.
   If `preserveUseListOrder` is set, the use-list order for each
@@ -42,6 +68,14 @@ def parseBitcodeFromFile (file : System.FilePath) : LlvmM ModuleRef := do
 constant writeBitcodeToFile (file : @& System.FilePath) (self : @& ModuleRef)
   (preserveUseListOrder := false) : IO PUnit
 
+/--
+  Write the bitcode of the module to a `ByteArray`.
+  See `writeBitcodeToFile` for the meaning of `preserveUseListOrder`.
+-/
+@[extern "papyrus_module_write_bitcode_to_byte_array"]
+constant writeBitcodeToByteArray (self : @& ModuleRef)
+  (preserveUseListOrder := false) : IO ByteArray
+
 /-- Get the module's identifier (which is, essentially, its name). -/
 @[extern "papyrus_module_get_id"]
 constant getModuleID (self : @& ModuleRef) : IO String
@@ -98,6 +132,13 @@ constant getFunctions (self : @& ModuleRef) : IO (Array FunctionRef)
 @[extern "papyrus_module_append_function"]
 constant appendFunction (fn : @& FunctionRef) (self : @& ModuleRef) : IO PUnit
 
+/--
+  Get the number of functions, global variables, basic blocks,
+  and instructions in this module.
+-/
+@[extern "papyrus_module_get_stats"]
+constant getStats (self : @& ModuleRef) : IO ModuleStats
+
 /--
   Check the module for errors. Errors are reported inside the `IO` monad.
 
@@ -138,6 +179,39 @@ constant eprint (self : @& ModuleRef)
 constant sprint (self : @& ModuleRef)
   (shouldPreserveUseListOrder := false) (isForDebug := false) : IO String
 
+/--
+  Print this module to the file at the given path,
+  overwriting the file if it already exists.
+  The module is streamed to the file without being built up in memory.
+
+  If`shouldPreserveUseListOrder`, the output will include `uselistorder`
+  directives so that use-lists can be recreated  when reading the assembly.
+-/
+@[extern "papyrus_module_print_to_file"]
+constant printToFile (self : @& ModuleRef) (file : @& System.FilePath)
+  (shouldPreserveUseListOrder := false) (isForDebug := false) : IO PUnit
+
+/--
+  Print this module to the given open file descriptor (which is not closed).
+
+  If`shouldPreserveUseListOrder`, the output will include `uselistorder`
+  directives so that use-lists can be recreated  when reading the assembly.
+-/
+@[extern "papyrus_module_print_to_fd"]
+constant printToFd (self : @& ModuleRef) (fd : UInt32)
+  (shouldPreserveUseListOrder := false) (isForDebug := false) : IO PUnit
+
+/--
+  Print each function definition in this module to a separate string
+  (in module order).
+
+  Intended for debug dumps of large modules. Metadata is numbered
+  per function, so the joined strings need not form a parseable module.
+-/
+@[extern "papyrus_module_sprint_functions"]
+constant sprintFunctions (self : @& ModuleRef)
+  (isForDebug := false) : IO (Array String)
+
 /-- Print this module to Lean's standard output for debugging. -/
 def dump (self : @& ModuleRef) : IO PUnit := do
   IO.print (← self.sprint (isForDebug := true))
@@ -60,42 +60,108 @@ def Type.typeID : (self : @& «Type») → TypeID
 
 -- # Type -> TypeRef
 
+namespace Type
+
+/-- Append the little-endian bytes of `n` to the array. -/
+private def pushUInt32 (bytes : ByteArray) (n : UInt32) : ByteArray := Id.run do
+  let mut bytes := bytes
+  for i in [0:4] do
+    bytes := bytes.push (n >>> (8 * i).toUInt32).toUInt8
+  bytes
+
+/-- Append the little-endian bytes of `n` to the array. -/
+private def pushUInt64 (bytes : ByteArray) (n : UInt64) : ByteArray := Id.run do
+  let mut bytes := bytes
+  for i in [0:8] do
+    bytes := bytes.push (n >>> (8 * i).toUInt64).toUInt8
+  bytes
+
+/-- Append the length and UTF-8 bytes of `s` to the array. -/
+private def pushString (bytes : ByteArray) (s : String) : ByteArray := Id.run do
+  let utf8 := s.toUTF8
+  let mut bytes := pushUInt32 bytes utf8.size.toUInt32
+  for b in utf8.data do
+    bytes := bytes.push b
+  bytes
+
+private def pushBool (bytes : ByteArray) (b : Bool) : ByteArray :=
+  bytes.push (if b then 1 else 0)
+
+/-- Append the encodings of the given types to the array. -/
+private def pushMany (encode : ByteArray → «Type» → ByteArray)
+(bytes : ByteArray) (types : Array «Type») : ByteArray :=
+  types.foldl encode (pushUInt32 bytes types.size.toUInt32)
+
 open BaseStructType in
-/-- Get a reference to an external LLVM representation of this type. -/
-partial def Type.getRef : (type : «Type») → LlvmM TypeRef
-| half => HalfTypeRef.get
-| bfloat => BFloatTypeRef.get
-| float => FloatTypeRef.get
-| double => DoubleTypeRef.get
-| x86FP80 => X86FP80TypeRef.get
-| fp128 => FP128TypeRef.get
-| ppcFP128 => PPCFP128TypeRef.get
-| void => VoidTypeRef.get
-| label => LabelTypeRef.get
-| metadata => MetadataTypeRef.get
-| x86MMX => X86MMXTypeRef.get
-| x86AMX => X86AMXTypeRef.get
-| token => TokenTypeRef.get
+/--
+  Append the compact binary encoding of this type to the array.
+  This is the encoding `lowerEncodedTypes` decodes, and lowered types
+  are memoized under it (i.e., it serves as their structural key).
+-/
+partial def encode (bytes : ByteArray) : (type : «Type») → ByteArray
+| half => bytes.push 0
+| bfloat => bytes.push 1
+| float => bytes.push 2
+| double => bytes.push 3
+| x86FP80 => bytes.push 4
+| fp128 => bytes.push 5
+| ppcFP128 => bytes.push 6
+| void => bytes.push 7
+| label => bytes.push 8
+| metadata => bytes.push 9
+| x86MMX => bytes.push 10
+| x86AMX => bytes.push 11
+| token => bytes.push 12
 | integer ⟨bitWidth⟩ =>
-  IntegerTypeRef.get bitWidth
-| function ⟨retType, paramTypes, isVarArg⟩ => do
-  FunctionTypeRef.get (← getRef retType) (← paramTypes.mapM getRef) isVarArg
-| pointer ⟨pointeeType, addrSpace⟩ => do
-  PointerTypeRef.get (← getRef pointeeType) addrSpace
+  pushUInt32 (bytes.push 13) bitWidth
+| function ⟨retType, paramTypes, isVarArg⟩ =>
+  let bytes := pushBool (bytes.push 14) isVarArg
+  paramTypes.foldl encode <| encode (pushUInt32 bytes paramTypes.size.toUInt32) retType
+| pointer ⟨pointeeType, addrSpace⟩ =>
+  encode (pushUInt32 (bytes.push 15) addrSpace.toUInt32) pointeeType
 | struct type =>
   match type with
-  | literal ⟨elemTypes, isPacked⟩ => do
-    LiteralStructTypeRef.get (← elemTypes.mapM getRef) isPacked
-  | complete name ⟨elemTypes, isPacked⟩ => do
-    IdentifiedStructTypeRef.getOrCreate name (← elemTypes.mapM getRef) isPacked
+  | literal ⟨elemTypes, isPacked⟩ =>
+    pushMany encode (pushBool (bytes.push 16 |>.push 0) isPacked) elemTypes
+  | complete name ⟨elemTypes, isPacked⟩ =>
+    let bytes := pushString (bytes.push 16 |>.push 1) name
+    pushMany encode (pushBool bytes isPacked) elemTypes
   | opaque name =>
-    IdentifiedStructTypeRef.getOrCreateOpaque name
-| array ⟨elemType, numElems⟩ => do
-  ArrayTypeRef.get (← getRef elemType) numElems
-| fixedVector ⟨elemType, numElems⟩ => do
-  FixedVectorTypeRef.get (← getRef elemType) numElems
-| scalableVector ⟨elemType, minNumElems⟩ => do
-  ScalableVectorTypeRef.get (← getRef elemType) minNumElems
+    pushString (bytes.push 16 |>.push 2) name
+| array ⟨elemType, size⟩ =>
+  encode (pushUInt64 (bytes.push 17) size) elemType
+| fixedVector ⟨elemType, size⟩ =>
+  encode (pushUInt32 (bytes.push 18) size) elemType
+| scalableVector ⟨elemType, minSize⟩ =>
+  encode (pushUInt32 (bytes.push 19) minSize) elemType
+
+end Type
+
+/--
+  Get references to the types encoded in the given bytes
+  (which hold `numTypes` type encodings).
+
+  Lowered types are memoized per context (keyed by their encoding),
+  so lowering a type again costs no LLVM type lookups. Types that mention
+  identified structs are not memoized, as the structs may have been renamed.
+-/
+@[extern "papyrus_type_lower_encoded"]
+constant lowerEncodedTypes (bytes : @& ByteArray) (numTypes : UInt32)
+  : LlvmM (Array TypeRef)
+
+/--
+  Get references to the external LLVM representations of the given types.
+  The whole batch is lowered in a single call.
+-/
+def Type.getRefs (types : Array «Type») : LlvmM (Array TypeRef) := do
+  let bytes := types.foldl Type.encode ByteArray.empty
+  lowerEncodedTypes bytes types.size.toUInt32
+
+/-- Get a reference to an external LLVM representation of this type. -/
+def Type.getRef (type : «Type») : LlvmM TypeRef := do
+  match (← lowerEncodedTypes (type.encode ByteArray.empty) 1).get? 0 with
+  | some ref => ref
+  | none => throw <| IO.userError "Type lowering returned no type"
 
 -- # TypeRef -> Type
 
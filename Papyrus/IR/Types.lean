@@ -90,7 +90,7 @@ def functionType (ret : «Type») (params : Array «Type») (isVarArg := false)
 -/
 def FunctionType.getRef (self : FunctionType) : LlvmM FunctionTypeRef := do
   FunctionTypeRef.get (← self.returnType.getRef)
-    (← self.parameterTypes.mapM (·.getRef)) self.isVarArg
+    (← Type.getRefs self.parameterTypes) self.isVarArg
 
 /-- Lift this reference to a pure `FunctionType`. -/
 def FunctionTypeRef.purify (self : FunctionTypeRef) : IO FunctionType := do
@@ -197,9 +197,9 @@ def opaqueStructType (name : String) : StructType :=
 -/
 def StructType.getRef : (self : StructType) → LlvmM StructTypeRef
 | literal ⟨elemTypes, isPacked⟩ => do
-    LiteralStructTypeRef.get (← elemTypes.mapM (·.getRef)) isPacked
+    LiteralStructTypeRef.get (← Type.getRefs elemTypes) isPacked
 | complete name ⟨elemTypes, isPacked⟩ => do
-  IdentifiedStructTypeRef.getOrCreate name (← elemTypes.mapM (·.getRef)) isPacked
+  IdentifiedStructTypeRef.getOrCreate name (← Type.getRefs elemTypes) isPacked
 | opaque name =>
   IdentifiedStructTypeRef.getOrCreateOpaque name
 
@@ -76,3 +76,49 @@ end ValueRef
 -/
 structure UserRef extends ValueRef
 instance : Coe UserRef ValueRef := ⟨(·.toValueRef)⟩
+
+namespace ValueRef
+
+/-- Get the number of uses of this value. -/
+@[extern "papyrus_value_get_num_uses"]
+constant getNumUses (self : @& ValueRef) : IO Nat
+
+/--
+  Get the array of references to the users of this value
+  (with a user repeated for each of its uses of this value).
+-/
+@[extern "papyrus_value_get_users"]
+constant getUsers (self : @& ValueRef) : IO (Array UserRef)
+
+/--
+  Replace every use of this value with the given value
+  (which must be of the same type).
+-/
+@[extern "papyrus_value_replace_all_uses_with"]
+constant replaceAllUsesWith (self : @& ValueRef) (newVal : @& ValueRef) : IO PUnit
+
+end ValueRef
+
+namespace UserRef
+
+/-- Get the number of operands of this user. -/
+@[extern "papyrus_user_get_num_operands"]
+constant getNumOperands (self : @& UserRef) : IO Nat
+
+/-- Get the array of references to the operands of this user. -/
+@[extern "papyrus_user_get_operands"]
+constant getOperands (self : @& UserRef) : IO (Array ValueRef)
+
+/-- Get the nth operand of this user. -/
+@[extern "papyrus_user_get_operand"]
+constant getOperand (i : UInt32) (self : @& UserRef) : IO ValueRef
+
+/--
+  Set the nth operand of this user to the given value
+  (which must be of the same type as the current operand).
+  The operands of constants cannot be changed.
+-/
+@[extern "papyrus_user_set_operand"]
+constant setOperand (i : UInt32) (val : @& ValueRef) (self : @& UserRef) : IO PUnit
+
+end UserRef
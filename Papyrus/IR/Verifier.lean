@@ -0,0 +1,61 @@
+import Papyrus.FFI
+import Papyrus.IR.FunctionRef
+import Papyrus.IR.ModuleRef
+
+namespace Papyrus
+
+/--
+  An opaque type representing a record of the functions
+  that last verified successfully (and their fingerprints).
+-/
+constant VerifierCache : Type := Unit
+
+/--
+  A reference to a verifier cache, used to incrementally verify modules.
+
+  A function is re-verified whenever its fingerprint changes.
+  The fingerprint covers the function's signature and attributes
+  and the opcode, type, flags, operands, metadata attachments, and
+  (for PHIs) incoming blocks of each of its instructions. Other in-place
+  changes (e.g., to an instruction's alignment) are not detected,
+  so functions changed that way should be `invalidate`d.
+-/
+def VerifierCacheRef := OwnedPtr VerifierCache
+
+namespace VerifierCacheRef
+
+/-- Create a new, empty verifier cache. -/
+@[extern "papyrus_verifier_cache_new"]
+constant new : IO VerifierCacheRef
+
+/-- Force the given function to be re-verified by the next incremental check. -/
+@[extern "papyrus_verifier_cache_invalidate"]
+constant invalidate (self : @& VerifierCacheRef) (fn : @& FunctionRef) : IO PUnit
+
+/-- Force every function to be re-verified by the next incremental check. -/
+@[extern "papyrus_verifier_cache_clear"]
+constant clear (self : @& VerifierCacheRef) : IO PUnit
+
+end VerifierCacheRef
+
+namespace ModuleRef
+
+/--
+  Check the function definitions of this module that changed since
+  they last verified successfully with the given cache for errors.
+  Errors are reported inside the `IO` monad.
+  Returns the number of functions verified.
+
+  The fingerprints of the functions are computed in parallel on `numThreads`
+  threads (or one per hardware thread if `numThreads` is 0), while the
+  changed functions are verified one at a time (as LLVM's verifier is not
+  thread safe within a context).
+
+  Unlike `verify`, this does not check module-level invariants
+  (e.g., of global variables or debug info shared between functions).
+-/
+@[extern "papyrus_module_verify_incremental"]
+constant verifyIncremental (self : @& ModuleRef) (cache : @& VerifierCacheRef)
+  (numThreads : UInt32 := 0) : IO Nat
+
+end ModuleRef
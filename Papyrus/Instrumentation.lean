@@ -0,0 +1,176 @@
+import Papyrus.FFI
+
+namespace Papyrus
+
+/--
+  A phase of compilation timed by Papyrus' instrumentation.
+  Each phase covers the Papyrus calls that perform it.
+-/
+inductive Phase
+| /-- IR construction (e.g., `Builder.module`). -/ construct
+| /-- Parsing bitcode into a module. -/ parse
+| /-- Verifying a module or function. -/ verify
+| /-- Printing a module. -/ print
+| /-- Writing a module's bitcode. -/ writeBitcode
+| /-- Creating an execution engine. -/ createEngine
+| /-- Generating machine code for the modules of an engine. -/ codegen
+| /-- Running a function in an execution engine. -/ execute
+deriving BEq, DecidableEq, Repr
+
+attribute [unbox] Phase
+instance : Inhabited Phase := ⟨Phase.construct⟩
+
+namespace Phase
+
+/-- All phases in the order Papyrus reports them. -/
+def all : Array Phase :=
+  #[construct, parse, verify, print, writeBitcode, createEngine, codegen, execute]
+
+end Phase
+
+/-- The accumulated time spent in a phase. -/
+structure PhaseTiming where
+  /-- The number of times the phase was entered. -/
+  count : UInt64
+  /-- The wall clock time spent in the phase (in seconds). -/
+  wallTime : Float
+  /-- The user CPU time spent in the phase (in seconds). -/
+  userTime : Float
+  /-- The system CPU time spent in the phase (in seconds). -/
+  systemTime : Float
+  deriving Inhabited, Repr
+
+/--
+  The value of an LLVM
+  [Statistic](https://llvm.org/doxygen/classllvm_1_1TrackingStatistic.html)
+  counter.
+-/
+structure Statistic where
+  name : String
+  value : UInt64
+  deriving Inhabited, Repr
+
+/-- A snapshot of the data collected by Papyrus' instrumentation. -/
+structure InstrumentationReport where
+  /-- The time spent in each phase. -/
+  phases : Array (Phase × PhaseTiming)
+  /-- LLVM's statistics (only collected by LLVM builds with them enabled). -/
+  statistics : Array Statistic
+  /-- LLVM's pass timing report (as printed by `-time-passes`). -/
+  passTimings : String
+  deriving Inhabited, Repr
+
+namespace Instrumentation
+
+/--
+  Start timing Papyrus' phases.
+
+  If `timePasses` is set, LLVM will also time the passes it runs
+  (e.g., instruction selection and object emission during JIT compilation).
+  If `collectStatistics` is set, LLVM will also collect its statistics.
+-/
+@[extern "papyrus_instrumentation_enable"]
+constant enable (timePasses := true) (collectStatistics := true) : IO PUnit
+
+/-- Stop timing Papyrus' phases and LLVM's passes. -/
+@[extern "papyrus_instrumentation_disable"]
+constant disable : IO PUnit
+
+/-- Reset the collected phase times, pass timings, and statistics. -/
+@[extern "papyrus_instrumentation_reset"]
+constant reset : IO PUnit
+
+/-- Get the time spent in each phase (indexed by the phase's position in `Phase.all`). -/
+@[extern "papyrus_instrumentation_get_phase_timings"]
+constant getPhaseTimings : IO (Array PhaseTiming)
+
+/-- Get LLVM's statistics. -/
+@[extern "papyrus_instrumentation_get_statistics"]
+constant getStatistics : IO (Array Statistic)
+
+/-- Get LLVM's pass timing report and reset its pass timers. -/
+@[extern "papyrus_instrumentation_take_pass_timings"]
+constant takePassTimings : IO String
+
+/--
+  Get a report of the data collected so far.
+  This resets LLVM's pass timers (but not the phase times).
+-/
+def getReport : IO InstrumentationReport := do
+  let timings ← getPhaseTimings
+  return {
+    phases := Phase.all.zip timings
+    statistics := ← getStatistics
+    passTimings := ← takePassTimings
+  }
+
+end Instrumentation
+
+-- # User Phases
+
+/-- An opaque type representing a running Papyrus phase timer. -/
+constant PhaseScope : Type := Unit
+
+/--
+  A reference to a running Papyrus phase timer.
+  Timers are only started and stopped by `withPhase`,
+  so that their trace events nest properly.
+-/
+def PhaseScopeRef := OwnedPtr PhaseScope
+
+namespace PhaseScopeRef
+
+/--
+  Start timing the given phase.
+  The phase ends when `stop` is called or the reference is garbage collected.
+-/
+@[extern "papyrus_phase_scope_start"]
+private constant start (phase : Phase) (detail : @& String := "") : IO PhaseScopeRef
+
+/-- End the phase (does nothing if it has already ended). -/
+@[extern "papyrus_phase_scope_stop"]
+private constant stop (self : @& PhaseScopeRef) : IO PUnit
+
+end PhaseScopeRef
+
+/-- Time the given action as the given phase (nested in any enclosing phase). -/
+def withPhase [Monad m] [MonadLiftT IO m] [MonadFinally m]
+(phase : Phase) (x : m α) (detail := "") : m α := do
+  let scope ← PhaseScopeRef.start phase detail
+  try x finally scope.stop
+
+-- # Chrome Tracing
+
+namespace TimeTrace
+
+/--
+  Start LLVM's time trace profiler on the current thread.
+  Events shorter than `granularity` microseconds are not recorded.
+
+  Papyrus' phases and LLVM's passes are recorded as trace events.
+-/
+@[extern "papyrus_time_trace_start"]
+constant start (granularity : UInt32 := 500) (procName : @& String := "papyrus") : IO PUnit
+
+/-- Write the recorded events to a file in the Chrome trace event JSON format. -/
+@[extern "papyrus_time_trace_write"]
+constant write (file : @& System.FilePath) : IO PUnit
+
+/-- Stop the time trace profiler, discarding any unwritten events. -/
+@[extern "papyrus_time_trace_stop"]
+constant stop : IO PUnit
+
+end TimeTrace
+
+/--
+  Run the given action under LLVM's time trace profiler
+  and write the recorded Chrome trace to `file`.
+-/
+def withTimeTrace (file : System.FilePath) (x : IO α) (granularity : UInt32 := 500) : IO α := do
+  TimeTrace.start granularity
+  try
+    let a ← x
+    TimeTrace.write file
+    return a
+  finally
+    TimeTrace.stop
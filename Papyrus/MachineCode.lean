@@ -0,0 +1,105 @@
+import Papyrus.IR.FunctionRef
+import Papyrus.ExecutionEngineRef
+
+namespace Papyrus
+
+-- # Disassembly
+
+/-- A machine instruction of compiled code. -/
+structure MachineInst where
+  /-- The address of the instruction in memory. -/
+  address : UInt64
+  /-- The size of the instruction's encoding (in bytes). -/
+  size : Nat
+  /--
+    The instruction in the target's assembly syntax (e.g., `movl $42, %eax`)
+    or `<unknown>` if its bytes could not be decoded.
+  -/
+  text : String
+  deriving Inhabited, Repr
+
+/-- The machine code compiled for a function. -/
+structure FunctionCode where
+  /-- The address of the code in memory. -/
+  address : UInt64
+  /-- The size of the code (in bytes), including any trailing padding. -/
+  size : Nat
+  /-- The disassembled instructions of the code. -/
+  instructions : Array MachineInst
+  deriving Inhabited, Repr
+
+namespace ExecutionEngineRef
+
+/--
+  Get the size (in bytes) of the machine code this (JIT) engine compiled
+  for the given function, compiling it if necessary.
+-/
+@[extern "papyrus_execution_engine_get_code_size"]
+constant getCodeSize (fn : @& FunctionRef) (self : @& ExecutionEngineRef) : IO Nat
+
+/--
+  Disassemble the machine code this (JIT) engine compiled
+  for the given function, compiling it if necessary.
+  The target's disassembler and assembly printer must have been initialized
+  (see `initNativeDisassembler` and `initNativeAsmPrinter`).
+-/
+@[extern "papyrus_execution_engine_disassemble"]
+constant disassemble (fn : @& FunctionRef) (self : @& ExecutionEngineRef) : IO FunctionCode
+
+end ExecutionEngineRef
+
+-- # Throughput Analysis
+
+/-- How heavily a pipeline resource of the CPU is used. -/
+structure ResourcePressure where
+  /-- The name of the resource in the CPU's scheduling model (e.g., `SKLPort0`). -/
+  resource : String
+  /-- The average number of cycles the resource is busy per iteration. -/
+  cyclesPerIteration : Float
+  deriving Inhabited, Repr
+
+/--
+  The estimated throughput of a sequence of machine instructions,
+  as simulated by LLVM's Machine Code Analyzer (see `llvm-mca`).
+-/
+structure ThroughputReport where
+  /-- The number of iterations of the instructions simulated. -/
+  iterations : Nat
+  /-- The number of instructions (per iteration). -/
+  numInstructions : Nat
+  /-- The number of micro-operations (per iteration). -/
+  numUops : Nat
+  /-- The number of cycles all iterations took. -/
+  totalCycles : Nat
+  /-- The number of cycles instructions were stalled on busy resources. -/
+  resourcePressureCycles : Nat
+  /-- The number of cycles instructions were stalled on register dependencies. -/
+  registerDependencyCycles : Nat
+  /-- The number of cycles instructions were stalled on memory dependencies. -/
+  memoryDependencyCycles : Nat
+  /-- The pressure on each resource the instructions used. -/
+  resourcePressure : Array ResourcePressure
+  /-- The average number of cycles per iteration. -/
+  cyclesPerIteration : Float
+  /-- The average number of instructions retired per cycle. -/
+  ipc : Float
+  deriving Inhabited, Repr
+
+namespace ExecutionEngineRef
+
+/--
+  Analyze the throughput of the machine code this (JIT) engine compiled
+  for the given function by simulating the given number of iterations of it
+  on the engine's CPU with LLVM's Machine Code Analyzer.
+
+  A slice of the function's instructions (e.g., a loop body) can be selected
+  by index, where a `count` of 0 selects all instructions from `first` on.
+  The target's disassembler must have been initialized
+  (see `initNativeDisassembler`).
+-/
+@[extern "papyrus_execution_engine_analyze_throughput"]
+constant analyzeThroughput (fn : @& FunctionRef) (iterations : UInt32 := 100)
+  (first : UInt32 := 0) (count : UInt32 := 0) (self : @& ExecutionEngineRef)
+  : IO ThroughputReport
+
+end ExecutionEngineRef
@@ -0,0 +1,119 @@
+import Papyrus.FFI
+import Papyrus.Context
+
+namespace Papyrus
+
+/-- The kind of an optimization remark. -/
+inductive RemarkKind
+| /-- An optimization was applied (e.g., a call was inlined). -/ passed
+| /-- An optimization was not applied (e.g., a loop was not vectorized). -/ missed
+| /-- Information gathered by an analysis (e.g., a loop's trip count). -/ analysis
+deriving BEq, DecidableEq, Repr
+
+instance : Inhabited RemarkKind := ⟨RemarkKind.passed⟩
+
+/-- The format optimization remarks can be written to a file in. -/
+inductive RemarkFormat
+| /-- YAML (like `-pass-remarks-output`), readable by `opt-viewer`. -/ yaml
+| /-- LLVM's compact binary remark format. -/ bitstream
+deriving BEq, DecidableEq, Repr
+
+instance : Inhabited RemarkFormat := ⟨RemarkFormat.yaml⟩
+
+/-- A source location (from debug info) an optimization remark refers to. -/
+structure RemarkLocation where
+  /-- The path of the source file. -/
+  file : String
+  /-- The line in the source file. -/
+  line : UInt32
+  /-- The column in the source file. -/
+  column : UInt32
+  deriving Inhabited, BEq, Repr
+
+/-- An argument of an optimization remark (e.g., `Callee: foo`). -/
+structure RemarkArg where
+  /-- The name of the argument (e.g., `Callee` or `Cost`). -/
+  key : String
+  /-- The value of the argument. -/
+  value : String
+  deriving Inhabited, BEq, Repr
+
+/--
+  An optimization remark emitted by an LLVM pass
+  (see [Remarks](https://llvm.org/docs/Remarks.html)).
+-/
+structure Remark where
+  /-- The kind of the remark. -/
+  kind : RemarkKind
+  /-- The name of the pass that emitted the remark (e.g., `inline`). -/
+  passName : String
+  /-- The identifier of the remark within its pass (e.g., `NoDefinition`). -/
+  name : String
+  /-- The name of the function the remark is about. -/
+  function : String
+  /-- The source location of the remark (if the IR has debug info). -/
+  location? : Option RemarkLocation
+  /-- The arguments of the remark, whose values make up its message. -/
+  args : Array RemarkArg
+  deriving Inhabited, BEq, Repr
+
+namespace Remark
+
+/-- The human-readable message of this remark. -/
+def message (self : Remark) : String :=
+  self.args.foldl (fun msg arg => msg ++ arg.value) ""
+
+/-- Get the value of the argument of this remark with the given key (if any). -/
+def getArg? (key : String) (self : Remark) : Option String :=
+  self.args.find? (·.key == key) |>.map (·.value)
+
+end Remark
+
+/-- An opaque type representing an external remark collector. -/
+constant RemarkCollector : Type := Unit
+
+/--
+  A reference to an external collector of the optimization remarks
+  emitted in an LLVM context. It collects the remarks of every pass run
+  in the context while it is active, including those run by optimization
+  (e.g., `ModuleRef.optimize`) and by code generation (e.g., JIT compilation).
+-/
+def RemarkCollectorRef := LinkedOwnedPtr ContextRef RemarkCollector
+
+namespace RemarkCollectorRef
+
+/--
+  Start collecting the remarks of the passes whose names match
+  the given regex (e.g., `inline|loop-vectorize`).
+
+  If `file` is not empty, the remarks are also written to it
+  in the given format (until the collector is stopped).
+-/
+@[extern "papyrus_remark_collector_start"]
+constant start (passes : @& String := ".*") (file : @& String := "")
+  (format := RemarkFormat.yaml) : LlvmM RemarkCollectorRef
+
+/--
+  Stop collecting remarks (and close the remark file, if any)
+  and get the remarks not taken yet.
+  Collectors of the same context must be stopped in reverse order of starting.
+-/
+@[extern "papyrus_remark_collector_stop"]
+constant stop (self : @& RemarkCollectorRef) : IO (Array Remark)
+
+/-- Take the remarks collected so far, without stopping the collector. -/
+@[extern "papyrus_remark_collector_take"]
+constant take (self : @& RemarkCollectorRef) : IO (Array Remark)
+
+end RemarkCollectorRef
+
+/--
+  Run the given action while collecting the remarks of the passes
+  whose names match the given regex (see `RemarkCollectorRef.start`).
+-/
+def withRemarks (act : LlvmM α) (passes : String := ".*")
+(file : System.FilePath := "") (format := RemarkFormat.yaml)
+: LlvmM (α × Array Remark) := do
+  let collector ← RemarkCollectorRef.start passes file.toString format
+  let a ← try act catch e => do discard collector.stop; throw e
+  return (a, ← collector.stop)
@@ -0,0 +1,102 @@
+import Papyrus.FFI
+import Papyrus.IR.InstructionKind
+import Papyrus.IR.FunctionRef
+
+namespace Papyrus
+
+-- # Rules
+
+/--
+  A pattern over LLVM IR values.
+
+  Variables are numbered from 0. A variable occurring more than once
+  only matches if all of its occurrences match the same value.
+-/
+inductive Pattern
+| /-- Matches any value and binds it to the variable of the given index. -/
+  var (idx : Nat)
+| /--
+    Matches an integer constant (or splat vector) of the given value.
+    Only matches constants of types the value fits in (signed or unsigned).
+  -/
+  int (val : Int)
+| /--
+    Matches an instruction of the given kind whose operands match the patterns.
+    Operands of commutative instructions (e.g., `add`) match in either order.
+  -/
+  inst (kind : InstructionKind) (ops : Array Pattern)
+
+instance : Inhabited Pattern := ⟨Pattern.var 0⟩
+
+/--
+  The value a rewrite rule replaces the instruction matched by its pattern with.
+  It has the type of the matched instruction.
+-/
+inductive Replacement
+| /-- The value bound to the variable of the given index by the pattern. -/
+  var (idx : Nat)
+| /--
+    An integer constant (or splat vector) of the given value.
+    The rule does not fire if the value does not fit in the type (signed or unsigned).
+  -/
+  int (val : Int)
+| /-- A new binary operator of the given kind (e.g., `shl`). -/
+  binOp (kind : InstructionKind) (lhs rhs : Replacement)
+
+instance : Inhabited Replacement := ⟨Replacement.var 0⟩
+
+/--
+  A peephole rewrite rule, which replaces the instructions
+  matching its pattern (which must match an instruction and may not match
+  a PHI anywhere) with its replacement.
+-/
+structure RewriteRule where
+  /-- The name of the rule. -/
+  name : String
+  /-- The pattern of the instructions to rewrite. -/
+  pattern : Pattern
+  /-- The value to replace a matched instruction with. -/
+  replacement : Replacement
+  deriving Inhabited
+
+/-- An opaque type representing a compiled set of rewrite rules. -/
+constant RewriteRules : Type := Unit
+
+/--
+  A reference to a set of rewrite rules compiled into native matchers,
+  which are indexed by the kind of instruction they match.
+-/
+def RewriteRulesRef := OwnedPtr RewriteRules
+
+namespace RewriteRulesRef
+
+/--
+  Compile the given rewrite rules.
+  Integer constants of the rules must fit in a machine word.
+-/
+@[extern "papyrus_rewrite_rules_compile"]
+constant compile (rules : @& Array RewriteRule) : IO RewriteRulesRef
+
+/-- Get the number of rules in this set. -/
+@[extern "papyrus_rewrite_rules_get_size"]
+constant getSize (self : @& RewriteRulesRef) : IO Nat
+
+end RewriteRulesRef
+
+-- # Rewriting
+
+namespace FunctionRef
+
+/--
+  Rewrite this function (which must be a definition) with the given rules
+  in a single native worklist pass, until no rule matches or `maxRewrites`
+  rewrites have been made. Where several rules match an instruction,
+  the first one wins. Instructions left dead by a rewrite are deleted.
+
+  Returns how many times each rule fired (in the order of the rules).
+-/
+@[extern "papyrus_function_rewrite"]
+constant rewrite (self : @& FunctionRef) (rules : @& RewriteRulesRef)
+  (maxRewrites : UInt32 := 10000) : IO (Array Nat)
+
+end FunctionRef
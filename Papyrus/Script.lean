@@ -6,3 +6,4 @@ import Papyrus.Script.Type
 import Papyrus.Script.Dump
 import Papyrus.Script.Verify
 import Papyrus.Script.Jit
+import Papyrus.Script.Rewrite
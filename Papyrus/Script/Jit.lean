@@ -3,13 +3,17 @@ import Papyrus.ExecutionEngineRef
 
 namespace Papyrus.Script
 
-/-- Run the  `main` function of a module with the given arguments and environment. -/
+/--
+  Run the  `main` function of a module with the given arguments and environment.
+
+  The module is run in the process-wide `JitSession`, so rerunning an
+  unchanged module (e.g., when a file is re-elaborated) does not compile it again.
+-/
 def jitMain (mod : ModuleRef) (args : Array String := #[]) (env : Array String := #[])
 : IO PUnit := do
   match (← mod.getFunction? "main") with
-  | some fn => do
-    let ee ← ExecutionEngineRef.createForModule mod
-    let rc ← ee.runFunctionAsMain fn args env
+  | some _ => do
+    let rc ← JitSession.runMain mod args env
     IO.println s!"Exited with code {rc}"
   | none => throw <| IO.userError "Module has no main function"
 
@@ -1,4 +1,5 @@
 import Lean.Parser
+import Lean.Elab.Command
 import Papyrus.Builders
 import Papyrus.Script.Do
 import Papyrus.Script.ParserUtil
@@ -33,3 +34,50 @@ def expandCmdLlvmModDef : Macro
   let doElems ← modDoElems.mapM expandMacros
   `($mods:declModifiers def $id:ident := module (name := $name) do {$[$doElems:doElem]*})
 | _ => Macro.throwUnsupported
+
+-- ## Precompiled Modules
+
+/--
+  Declare a module whose IR is built once, at compile time.
+
+  `llvm bitcode module foo do ...` builds the module while the command is
+  elaborated and embeds its bitcode in the declaration (as a hex string).
+  Evaluating `foo` then just parses that bitcode, which avoids the FFI calls
+  needed to construct the IR at runtime. Building the module at compile time
+  requires the Papyrus plugin to be loaded.
+-/
+scoped syntax (name := cmdLlvmBitcodeModDef)
+declModifiers "llvm " &"bitcode " &"module " llvmModDef : command
+
+section
+open Elab Command
+
+private unsafe def evalBitcodeUnsafe (x : Syntax) : Elab.Term.TermElabM ByteArray := do
+  let type := mkApp (mkConst ``IO) (mkConst ``ByteArray)
+  let act ← Elab.Term.evalTerm (IO ByteArray) type x
+  act
+
+@[implementedBy evalBitcodeUnsafe]
+private constant evalBitcode (x : Syntax) : Elab.Term.TermElabM ByteArray
+
+/-- Encode bytes as a string of hexadecimal digits (two per byte). -/
+private def hexOfBytes (bytes : ByteArray) : String :=
+  bytes.data.foldl (init := "") fun hex b =>
+    hex.push (Nat.digitChar (b.toNat / 16)) |>.push (Nat.digitChar (b.toNat % 16))
+
+@[commandElab cmdLlvmBitcodeModDef]
+def elabCmdLlvmBitcodeModDef : CommandElab
+| `($mods:declModifiers llvm bitcode module $id:ident do $seq) => do
+  let name := identAsStrLit id
+  let modDoElems ← liftMacroM <| expandModDoSeq seq
+  let doElems ← liftMacroM <| modDoElems.mapM expandMacros
+  let build ← `(LlvmM.run do
+    ModuleRef.writeBitcodeToByteArray (← module (name := $name) do {$[$doElems:doElem]*}))
+  let bytes ← liftTermElabM none <| evalBitcode build
+  -- A single string literal keeps elaboration and initialization cheap
+  let hex := Syntax.mkStrLit (hexOfBytes bytes)
+  elabCommand <| ← `($mods:declModifiers def $id:ident : LlvmM ModuleRef :=
+    ModuleRef.parseBitcodeFromHex $hex $name)
+| _ => throwUnsupportedSyntax
+
+end
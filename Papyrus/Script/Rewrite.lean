@@ -0,0 +1,94 @@
+import Lean.Parser
+import Papyrus.Rewrite
+import Papyrus.Script.ParserUtil
+import Papyrus.Script.SyntaxUtil
+
+namespace Papyrus.Script
+open Lean Parser
+
+-- # Patterns
+
+/-
+  Patterns (and replacements) are written like instructions whose operands are
+  `%`-variables, integer literals, or parenthesized nested instructions,
+  e.g., `add (mul %x, 2), %x`.
+-/
+
+declare_syntax_cat llvmPattern
+
+syntax:max (name := varPattern) "%" ident : llvmPattern
+syntax:max (name := intPattern) num : llvmPattern
+syntax:max (name := negIntPattern) negNumLit : llvmPattern
+syntax:max (name := parenPattern) "(" llvmPattern ")" : llvmPattern
+syntax:lead (name := instPattern) ident sepBy1(llvmPattern:max, ", ") : llvmPattern
+
+def expandInstKind (kind : Syntax) : Syntax :=
+  mkCIdentFrom kind (``InstructionKind ++ kind.getId)
+
+/--
+  Expand a pattern, numbering its variables in order of first occurrence.
+  The state holds the names of the variables numbered so far.
+-/
+partial def expandPattern (stx : Syntax) : StateT (Array Name) MacroM Syntax := do
+  let kind := stx.getKind
+  if kind == ``varPattern then
+    let var := stx[1].getId
+    let vars ← get
+    match vars.getIdx? var with
+    | some idx => ``(Pattern.var $(quote idx))
+    | none => set (vars.push var); ``(Pattern.var $(quote vars.size))
+  else if kind == ``intPattern then
+    ``(Pattern.int $(stx[0]))
+  else if kind == ``negIntPattern then
+    ``(Pattern.int $(← expandNegNumLit stx[0]))
+  else if kind == ``parenPattern then
+    expandPattern stx[1]
+  else if kind == ``instPattern then
+    let ops ← stx[1].getSepArgs.mapM expandPattern
+    ``(Pattern.inst $(expandInstKind stx[0]) #[$[$ops],*])
+  else
+    Macro.throwErrorAt stx "ill-formed rewrite pattern"
+
+/-- Expand a replacement over the variables bound by its pattern. -/
+partial def expandReplacement (vars : Array Name) (stx : Syntax) : MacroM Syntax := do
+  let kind := stx.getKind
+  if kind == ``varPattern then
+    match vars.getIdx? stx[1].getId with
+    | some idx => ``(Replacement.var $(quote idx))
+    | none => Macro.throwErrorAt stx[1] "variable is not bound by the pattern"
+  else if kind == ``intPattern then
+    ``(Replacement.int $(stx[0]))
+  else if kind == ``negIntPattern then
+    ``(Replacement.int $(← expandNegNumLit stx[0]))
+  else if kind == ``parenPattern then
+    expandReplacement vars stx[1]
+  else if kind == ``instPattern then
+    match stx[1].getSepArgs with
+    | #[lhs, rhs] =>
+      ``(Replacement.binOp $(expandInstKind stx[0])
+        $(← expandReplacement vars lhs) $(← expandReplacement vars rhs))
+    | _ => Macro.throwErrorAt stx "replacement instructions must be binary operators"
+  else
+    Macro.throwErrorAt stx "ill-formed rewrite replacement"
+
+-- # Rules
+
+/--
+  Declare a peephole rewrite rule (see `RewriteRule`), e.g.:
+
+  ```
+  llvm rewrite mulByTwo : mul %x, 2 => shl %x, 1
+  ```
+-/
+scoped syntax (name := cmdLlvmRewriteDef)
+declModifiers "llvm " &"rewrite " ident " : " llvmPattern " => " llvmPattern : command
+
+@[macro cmdLlvmRewriteDef]
+def expandCmdLlvmRewriteDef : Macro
+| stx => do
+  let mods := stx[0]
+  let id := stx[3]
+  let (pat, vars) ← expandPattern stx[5] |>.run #[]
+  let repl ← expandReplacement vars stx[7]
+  `($mods:declModifiers def $id:ident : RewriteRule :=
+    {name := $(identAsStrLit id), pattern := $pat, replacement := $repl})
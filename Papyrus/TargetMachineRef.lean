@@ -0,0 +1,114 @@
+import Papyrus.FFI
+import Papyrus.IR.TypeRef
+import Papyrus.IR.InstructionRef
+import Papyrus.ExecutionEngineRef
+
+namespace Papyrus
+
+/--
+  The kind of cost LLVM's cost model estimates
+  (see [TargetCostKind](https://llvm.org/doxygen/classllvm_1_1TargetTransformInfo.html)).
+-/
+inductive CostKind
+| /-- The reciprocal throughput (i.e., issue slots consumed). -/ recipThroughput
+| /-- The latency of the result. -/ latency
+| /-- The size of the generated code. -/ codeSize
+| /-- A weighted combination of code size and latency. -/ sizeAndLatency
+deriving BEq, DecidableEq, Repr
+
+attribute [unbox] CostKind
+instance : Inhabited CostKind := ⟨CostKind.recipThroughput⟩
+
+/-- Register, register file, and cache parameters of a target. -/
+structure TargetInfo where
+  /-- The width of a scalar register (in bits). -/
+  scalarRegisterBits : Nat
+  /-- The width of a (fixed-width) vector register (in bits). -/
+  vectorRegisterBits : Nat
+  /-- The narrowest vector register width the vectorizers should use (in bits). -/
+  minVectorRegisterBits : Nat
+  /-- The number of scalar registers. -/
+  numScalarRegisters : Nat
+  /-- The number of vector registers. -/
+  numVectorRegisters : Nat
+  /-- The size of a cache line (in bytes) or 0 if unknown. -/
+  cacheLineSize : Nat
+  deriving Inhabited, Repr
+
+/-- An opaque type representing an external LLVM target machine. -/
+constant TargetMachine : Type := Unit
+
+/--
+  A reference to an external LLVM
+  [TargetMachine](https://llvm.org/doxygen/classllvm_1_1TargetMachine.html).
+
+  It provides access to the target's cost model, e.g., to choose vector
+  widths or unroll factors before emitting IR.
+-/
+def TargetMachineRef := OwnedPtr TargetMachine
+
+namespace TargetMachineRef
+
+/--
+  Create a target machine for the given triple, CPU, and features
+  (e.g., `+avx2,-sse4a`). The target must have been initialized.
+-/
+@[extern "papyrus_target_machine_create"]
+constant create (triple : @& String) (cpu : @& String := "") (features : @& String := "")
+  (optLevel : @& OptLevel := OptLevel.default) : IO TargetMachineRef
+
+/--
+  Create a target machine for the host's triple, CPU, and CPU features.
+  The native target must have been initialized (see `initNativeTarget`).
+-/
+@[extern "papyrus_target_machine_create_host"]
+constant createHost (optLevel : @& OptLevel := OptLevel.default) : IO TargetMachineRef
+
+/-- Get the target triple of this target machine. -/
+@[extern "papyrus_target_machine_get_triple"]
+constant getTriple (self : @& TargetMachineRef) : IO String
+
+/-- Get the CPU of this target machine. -/
+@[extern "papyrus_target_machine_get_cpu"]
+constant getCPU (self : @& TargetMachineRef) : IO String
+
+/-- Get the CPU features of this target machine. -/
+@[extern "papyrus_target_machine_get_features"]
+constant getFeatures (self : @& TargetMachineRef) : IO String
+
+/-- Get the register, register file, and cache parameters of this target. -/
+@[extern "papyrus_target_machine_get_info"]
+constant getInfo (self : @& TargetMachineRef) : IO TargetInfo
+
+/--
+  Get the estimated cost of an instruction (which must be in a function)
+  on this target, or `none` if the cost model cannot estimate it.
+-/
+@[extern "papyrus_target_machine_get_instruction_cost"]
+constant getInstructionCost (inst : @& InstructionRef)
+  (kind : @& CostKind := CostKind.recipThroughput) (self : @& TargetMachineRef)
+  : IO (Option Nat)
+
+/--
+  Get the estimated cost of a call of the named intrinsic (e.g., `llvm.sqrt.f64`)
+  with the given return and parameter types on this target,
+  or `none` if the cost model cannot estimate it.
+-/
+@[extern "papyrus_target_machine_get_intrinsic_cost"]
+constant getIntrinsicCost (name : @& String) (retType : @& TypeRef)
+  (paramTypes : @& Array TypeRef) (kind : @& CostKind := CostKind.recipThroughput)
+  (self : @& TargetMachineRef) : IO (Option Nat)
+
+/-- Get whether the given type is legal (i.e., fits in a register) on this target. -/
+@[extern "papyrus_target_machine_is_type_legal"]
+constant isTypeLegal (type : @& TypeRef) (self : @& TargetMachineRef) : IO Bool
+
+/--
+  Get the lengths (powers of two, in increasing order) of the fixed vectors
+  of the given element type that are legal on this target.
+-/
+@[extern "papyrus_target_machine_get_legal_vector_lengths"]
+constant getLegalVectorLengths (elemType : @& TypeRef) (self : @& TargetMachineRef)
+  : IO (Array Nat)
+
+end TargetMachineRef
@@ -0,0 +1,220 @@
+import Papyrus.FFI
+import Papyrus.IR.ConstantRef
+import Papyrus.IR.FunctionRef
+import Papyrus.IR.ModuleRef
+import Papyrus.IR.InstructionRefs
+import Papyrus.TargetMachineRef
+import Papyrus.ExecutionEngineRef
+
+namespace Papyrus
+
+-- # Optimization
+
+namespace ModuleRef
+
+/--
+  Optimize the module with LLVM's standard optimization pipeline
+  at the given level (like `opt -O<n>`).
+
+  Profile data attached to the module (see `ProfileRef.apply`) guides
+  the pipeline's inlining and code layout decisions.
+-/
+@[extern "papyrus_module_optimize"]
+constant optimize (self : @& ModuleRef) (optLevel : @& OptLevel := OptLevel.default) : IO PUnit
+
+-- # Linking
+
+/--
+  Link a copy of the given module (which must be in the same context)
+  into this module. The given module is left unchanged, so it can be
+  linked into many modules (e.g., as a prelude).
+
+  If `lazy`, only the definitions this module references
+  (directly or transitively) are linked.
+
+  Declarations of this module that the link resolves are replaced by
+  the linked definitions and deleted. Any references to them become invalid.
+-/
+@[extern "papyrus_module_link"]
+constant link (self : @& ModuleRef) (src : @& ModuleRef) (lazy := false) : IO PUnit
+
+/--
+  Give every definition in this module except the named exports
+  internal linkage and then delete the globals no export can reach
+  (like `opt -internalize -globaldce`).
+  Returns the number of globals deleted.
+  Any references to the deleted globals become invalid.
+-/
+@[extern "papyrus_module_internalize"]
+constant internalize (self : @& ModuleRef) (exports : @& Array String) : IO Nat
+
+/--
+  Link the given modules into this one and strip everything
+  the named exports cannot reach, so that only reachable code is compiled.
+-/
+def linkAndInternalize (self : @& ModuleRef) (srcs : Array ModuleRef)
+(exports : Array String) (lazy := true) : IO PUnit := do
+  for src in srcs do
+    self.link src lazy
+  discard <| self.internalize exports
+
+end ModuleRef
+
+-- # Cloning and Specialization
+
+namespace FunctionRef
+
+/--
+  Simplify this function (which must be a definition in a module) locally:
+  propagate constants, combine instructions, and fold away
+  the branches and blocks that become dead.
+-/
+@[extern "papyrus_function_simplify"]
+constant simplify (self : @& FunctionRef) : IO PUnit
+
+/-- Clone this function (which must be a definition) into its module. -/
+@[extern "papyrus_function_clone"]
+constant clone (self : @& FunctionRef) (name : @& String := "") : IO FunctionRef
+
+/--
+  Specialize this function (which must be a definition in a module)
+  for known values of its arguments. Each `some` constant replaces the
+  argument at its index (missing trailing entries are treated as `none`).
+  The specialized clone is added to the module, only takes the remaining
+  arguments, and is `simplify`-ed unless `simplify` is `false`.
+
+  The clone is named after the function and the constants, so specializing
+  the function for the same constants again returns the existing clone.
+-/
+@[extern "papyrus_function_specialize"]
+constant specialize (self : @& FunctionRef) (args : @& Array (Option ConstantRef))
+  (simplify := true) : IO FunctionRef
+
+end FunctionRef
+
+-- # Inlining
+
+/-- The kind of cost LLVM's inline cost model estimated for a call. -/
+inductive InlineCostKind
+| /-- The call must be inlined (e.g., its callee is `alwaysinline`). -/ always
+| /-- The call cannot or must not be inlined (e.g., its callee is `noinline`). -/ never
+| /-- The call is worth inlining if its cost is below its threshold. -/ conditional
+deriving BEq, DecidableEq, Repr
+
+instance : Inhabited InlineCostKind := ⟨InlineCostKind.conditional⟩
+
+/-- The estimated cost of inlining a call. -/
+structure InlineCost where
+  /-- The kind of the cost. -/
+  kind : InlineCostKind
+  /-- The estimated cost (for `conditional` costs; 0 otherwise). -/
+  cost : Int
+  /-- The threshold the cost was compared against (adjusted for the call). -/
+  threshold : Int
+  /-- Why the call must (not) be inlined (for `always` and `never` costs). -/
+  reason : String
+  deriving Inhabited, Repr
+
+namespace InlineCost
+
+/-- Whether the call is worth inlining according to this cost. -/
+def isFavorable (self : InlineCost) : Bool :=
+  match self.kind with
+  | InlineCostKind.always => true
+  | InlineCostKind.never => false
+  | InlineCostKind.conditional => self.cost < self.threshold
+
+end InlineCost
+
+namespace CallInstRef
+
+/--
+  Inline the function called by this (direct) call into its caller,
+  regardless of the cost. Fails if LLVM cannot inline the call.
+  On success, the call is deleted and any references to it become invalid.
+-/
+@[extern "papyrus_call_inst_inline"]
+constant inlineCallee (self : @& CallInstRef) : IO PUnit
+
+/--
+  Estimate the cost of inlining this (direct) call with LLVM's
+  inline cost model against the given threshold (LLVM's default is 225).
+  Without a target machine, target-independent costs are assumed.
+-/
+@[extern "papyrus_call_inst_get_inline_cost"]
+constant getInlineCost (self : @& CallInstRef) (threshold : UInt32 := 225)
+  (tm? : @& Option TargetMachineRef := none) : IO InlineCost
+
+end CallInstRef
+
+namespace ModuleRef
+
+/--
+  Inline the calls of this module whose estimated inline cost
+  (see `CallInstRef.getInlineCost`) is favorable under the given threshold.
+
+  Functions are visited bottom-up (i.e., callees before their callers),
+  so a call's cost accounts for what was already inlined into its callee.
+  Calls within a recursive cycle are not inlined.
+  Returns the number of calls inlined.
+  Any references to the inlined calls become invalid.
+
+  If `removeDead`, internal functions left unused are also deleted,
+  and any references to them become invalid (see also `internalize`).
+-/
+@[extern "papyrus_module_inline"]
+constant inlineCalls (self : @& ModuleRef) (threshold : UInt32 := 225)
+  (tm? : @& Option TargetMachineRef := none) (removeDead := false) : IO Nat
+
+end ModuleRef
+
+-- # Profile-Guided Optimization
+
+/-- An opaque type representing an in-memory execution profile of a module. -/
+constant Profile : Type := Unit
+
+/--
+  A reference to an in-memory execution profile of a module.
+
+  A profile records how often each basic block ran and which way each
+  conditional branch went. It is used as follows:
+
+  1. `instrument` a module, which produces an instrumented copy of it.
+  2. Run the copy in an execution engine on representative inputs.
+  3. `collect` the counts from the engine (possibly repeatedly).
+  4. `apply` the profile to the original module and `optimize` it.
+-/
+def ProfileRef := OwnedPtr Profile
+
+namespace ProfileRef
+
+/--
+  Create a copy of the module instrumented with block and branch counters,
+  along with the (empty) profile those counters are collected into.
+-/
+@[extern "papyrus_profile_instrument"]
+constant instrument (mod : @& ModuleRef) : IO (ModuleRef × ProfileRef)
+
+/--
+  Add the counts recorded by the profile's instrumented module
+  in the given engine to the profile and reset them.
+-/
+@[extern "papyrus_profile_collect"]
+constant collect (self : @& ProfileRef) (ee : @& ExecutionEngineRef) : IO PUnit
+
+/--
+  Annotate a module (e.g., the one that was instrumented) with the profile.
+  Sets the entry counts of its functions, the branch weights of its
+  conditional branches and switches, and the module's profile summary.
+
+  Functions whose control flow changed since the module was instrumented
+  are skipped. Returns the number of functions annotated.
+-/
+@[extern "papyrus_profile_apply"]
+constant apply (self : @& ProfileRef) (mod : @& ModuleRef) : IO Nat
+
+/-- Get the number of times the named function was entered. -/
+@[extern "papyrus_profile_get_entry_count"]
+constant getEntryCount (self : @& ProfileRef) (fnName : @& String) : IO UInt64
+
+end ProfileRef
@@ -0,0 +1,215 @@
+import Papyrus
+
+open Papyrus Builder
+
+--------------------------------------------------------------------------------
+-- # Harness
+--------------------------------------------------------------------------------
+
+/-- The result of a benchmark run. -/
+structure Result where
+  name : String
+  size : Nat
+  iters : Nat
+  nsPerOp : Nat
+
+namespace Result
+
+def header : String :=
+  "name\tsize\titers\tns_per_op"
+
+def toRow (self : Result) : String :=
+  s!"{self.name}\t{self.size}\t{self.iters}\t{self.nsPerOp}"
+
+/-- Parse a row produced by `toRow`. -/
+def ofRow? (row : String) : Option Result :=
+  match row.splitOn "\t" with
+  | [name, size, iters, ns] => do
+    some {name, size := ← size.toNat?, iters := ← iters.toNat?, nsPerOp := ← ns.toNat?}
+  | _ => none
+
+end Result
+
+/-- Record the result of a benchmark that took `ns` nanoseconds in total. -/
+def report (name : String) (size iters ns : Nat) : IO Result := do
+  let res := {name, size, iters, nsPerOp := ns / iters : Result}
+  IO.println res.toRow
+  return res
+
+/-- Time `iters` runs of `act` (after a warm-up run). -/
+def measure (name : String) (size iters : Nat) (act : LlvmM PUnit) : LlvmM Result := do
+  act
+  let start ← IO.monoNanosNow
+  for _ in [0:iters] do act
+  let stop ← IO.monoNanosNow
+  report name size iters (stop - start)
+
+/--
+  Time `iters` runs of `act` (after a warm-up run),
+  each on a fresh input produced by `setup` outside the timed region.
+-/
+def measureFresh (name : String) (size iters : Nat)
+(setup : LlvmM α) (act : α → LlvmM PUnit) : LlvmM Result := do
+  act (← setup)
+  let mut ns := 0
+  for _ in [0:iters] do
+    let input ← setup
+    let start ← IO.monoNanosNow
+    act input
+    let stop ← IO.monoNanosNow
+    ns := ns + (stop - start)
+  report name size iters ns
+
+/-- The number of iterations to run a benchmark of the given size. -/
+def itersFor (size : Nat) (budget := 100000) : Nat :=
+  max 1 (budget / max 1 size)
+
+def scalingSizes : Array Nat := #[10, 100, 1000, 10000]
+
+--------------------------------------------------------------------------------
+-- # Fixtures
+--------------------------------------------------------------------------------
+
+/-- Build a module whose `main` makes a chain of `n` calls to an identity function. -/
+def mkChainModule (n : Nat) : LlvmM ModuleRef := do
+  let i32 ← IntegerTypeRef.get 32
+  let stepTy ← FunctionTypeRef.get i32 #[i32]
+  let mainTy ← FunctionTypeRef.get i32 #[]
+  module "chain" do
+    let step ← define stepTy (name := "step") do
+      ret (← getArg 0)
+    discard <| define mainTy (name := "main") do
+      let mut x := (← ConstantIntRef.ofUInt32 1).toValueRef
+      for _ in [0:n] do
+        x := (← call step #[x]).toValueRef
+      ret x
+
+def benchDir : System.FilePath := "build"
+
+--------------------------------------------------------------------------------
+-- # Benchmarks
+--------------------------------------------------------------------------------
+
+/-- Per-call overhead of the FFI layer. -/
+def ffiBenchmarks : LlvmM (Array Result) := do
+  let mod ← mkChainModule 1
+  let fn ← mod.getFunction "step"
+  let iters := 100000
+  let mkValueRef ← measure "ffi.mk_value_ref" 1 iters do
+    discard <| fn.getArg 0
+  let getIntegerType ← measure "ffi.get_integer_type" 1 iters do
+    discard <| IntegerTypeRef.get 32
+  return #[mkValueRef, getIntegerType]
+
+/-- Scaling of IR construction, printing, and bitcode I/O with module size. -/
+def irBenchmarks : LlvmM (Array Result) := do
+  IO.FS.createDirAll benchDir
+  let bcFile := benchDir / "bench.bc"
+  let mut results := #[]
+  for n in scalingSizes do
+    let iters := itersFor n
+    let build ← measure "ir.build_function" n iters do
+      discard <| mkChainModule n
+    let mod ← mkChainModule n
+    let print ← measure "ir.print_module" n iters do
+      discard <| mod.sprint
+    let write ← measure "bitcode.write" n iters do
+      mod.writeBitcodeToFile bcFile
+    let parse ← measure "bitcode.parse" n iters do
+      discard <| ModuleRef.parseBitcodeFromFile bcFile
+    results := results ++ #[build, print, write, parse]
+  return results
+
+/-- Latency of engine creation, JIT compilation, and execution. -/
+def jitBenchmarks : LlvmM (Array Result) := do
+  let mod ← mkChainModule 1
+  let create ← measure "jit.create_engine" 1 1000 do
+    discard <| ExecutionEngineRef.createForModule mod
+  let mut results := #[create]
+  for n in #[1, 100, 1000] do
+    -- JIT compilation lowers a module in place, so each first run needs a fresh one
+    let firstRun ← measureFresh "jit.first_run" n (itersFor n 10000)
+      (do let mod ← mkChainModule n; return (mod, ← mod.getFunction "main"))
+      fun (mod, main) => do
+        let ee ← ExecutionEngineRef.createForModule mod
+        discard <| ee.runFunction main
+    let mod ← mkChainModule n
+    let main ← mod.getFunction "main"
+    let ee ← ExecutionEngineRef.createForModule mod
+    let run ← measure "jit.run_function" n 10000 do
+      discard <| ee.runFunction main
+    results := results ++ #[firstRun, run]
+  return results
+
+--------------------------------------------------------------------------------
+-- # Baseline Comparison
+--------------------------------------------------------------------------------
+
+def readResults (file : System.FilePath) : IO (Array Result) := do
+  let lines ← IO.FS.lines file
+  return lines.filterMap Result.ofRow?
+
+def writeResults (file : System.FilePath) (results : Array Result) : IO PUnit := do
+  let rows := results.map Result.toRow
+  IO.FS.writeFile file <| "\n".intercalate (Result.header :: rows.toList) ++ "\n"
+
+/--
+  Compare the results against a baseline and return the number of benchmarks
+  that got more than `threshold` percent slower.
+-/
+def compare (baseline results : Array Result) (threshold : Nat) : IO Nat := do
+  IO.println "name\tsize\tbaseline_ns\tcurrent_ns\tchange_pct"
+  let mut regressions := 0
+  for res in results do
+    match baseline.find? (fun b => b.name == res.name && b.size == res.size) with
+    | some base =>
+      let change : Int :=
+        (Int.ofNat res.nsPerOp - Int.ofNat base.nsPerOp) * 100 / Int.ofNat (max 1 base.nsPerOp)
+      let regressed := change > Int.ofNat threshold
+      if regressed then regressions := regressions + 1
+      let mark := if regressed then "\tREGRESSION" else ""
+      IO.println s!"{res.name}\t{res.size}\t{base.nsPerOp}\t{res.nsPerOp}\t{change}{mark}"
+    | none =>
+      IO.println s!"{res.name}\t{res.size}\t-\t{res.nsPerOp}\t-"
+  return regressions
+
+--------------------------------------------------------------------------------
+-- # Runner
+--------------------------------------------------------------------------------
+
+structure Options where
+  out : Option System.FilePath := none
+  baseline : Option System.FilePath := none
+  threshold : Nat := 10
+
+def parseArgs (opts : Options) : List String → IO Options
+| "--out" :: file :: rest => parseArgs {opts with out := some ⟨file⟩} rest
+| "--baseline" :: file :: rest => parseArgs {opts with baseline := some ⟨file⟩} rest
+| "--threshold" :: pct :: rest =>
+  match pct.toNat? with
+  | some n => parseArgs {opts with threshold := n} rest
+  | none => throw <| IO.userError s!"invalid threshold '{pct}'"
+| [] => pure opts
+| arg :: _ => throw <| IO.userError s!"unknown argument '{arg}'"
+
+def main (args : List String) : IO UInt32 := do
+  let opts ← parseArgs {} args
+  if (← initNativeTarget) then
+    throw <| IO.userError "failed to initialize native target"
+  if (← initNativeAsmPrinter) then
+    throw <| IO.userError "failed to initialize native asm printer"
+  IO.println Result.header
+  let results ← LlvmM.run do
+    return (← ffiBenchmarks) ++ (← irBenchmarks) ++ (← jitBenchmarks)
+  match opts.out with
+  | some file => writeResults file results
+  | none => pure ()
+  match opts.baseline with
+  | some file =>
+    IO.println s!"\nComparing against {file} (threshold {opts.threshold}%) ..."
+    let regressions ← compare (← readResults file) results opts.threshold
+    if regressions > 0 then
+      IO.eprintln s!"{regressions} benchmark(s) regressed"
+      return 1
+    return 0
+  | none => return 0
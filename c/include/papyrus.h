@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
 #include <lean/lean.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
 
 // Forward declarations
 namespace llvm {
@@ -19,6 +21,9 @@ namespace llvm {
 	class GlobalVariable;
 	class Function;
 	class GenericValue;
+	class ExecutionEngine;
+	class TargetMachine;
+	struct TimeTraceProfiler;
 }
 
 namespace papyrus {
@@ -72,6 +77,7 @@ lean_obj_res mkTypeRef(b_lean_obj_arg ctxRef, llvm::Type* type);
 llvm::Type* toType(b_lean_obj_arg ref);
 llvm::IntegerType* toIntegerType(b_lean_obj_arg ref);
 llvm::FunctionType* toFunctionType(b_lean_obj_arg ref);
+void forgetLoweredTypes(llvm::LLVMContext* ctx);
 
 lean_obj_res mkValueRef(lean_obj_arg ctxRef, llvm::Value* value);
 lean_obj_res getValueContext(b_lean_obj_arg ref);
@@ -81,6 +87,7 @@ lean_obj_res mkConstantRef(lean_obj_arg ctxRef, llvm::Constant* ptr);
 llvm::Constant* toConstant(b_lean_obj_arg ref);
 
 llvm::Instruction* toInstruction(b_lean_obj_arg ref);
+bool isValidBinaryOp(unsigned opcode, llvm::Type* type);
 llvm::BasicBlock* toBasicBlock(b_lean_obj_arg ref);
 llvm::GlobalVariable* toGlobalVariable(b_lean_obj_arg ref);
 llvm::Function* toFunction(b_lean_obj_arg ref);
@@ -88,15 +95,77 @@ llvm::Function* toFunction(b_lean_obj_arg ref);
 lean_obj_res mkGenericValueRef(llvm::GenericValue* val);
 llvm::GenericValue* toGenericValue(b_lean_obj_arg ref);
 
-// Covert a Lean Array of references to an LLVM ArrayRef of objects.
-// Defined as a macro because it needs to dynamically allocate to the user's stack.
-#define LEAN_ARRAY_TO_REF(ELEM_TYPE, CONVERTER, OBJ, REF) \
-	auto OBJ##_arr = lean_to_array(OBJ); \
-	auto OBJ##_len = OBJ##_arr->m_size; \
-	ELEM_TYPE REF##_data[OBJ##_len]; \
-	for (auto i = 0; i < OBJ##_len; i++) { \
-		REF##_data[i] = CONVERTER(OBJ##_arr->m_data[i]); \
-	} \
-	ArrayRef<ELEM_TYPE> REF(REF##_data, OBJ##_len)
+llvm::ExecutionEngine* toExecutionEngine(b_lean_obj_arg ref);
+llvm::TargetMachine* toTargetMachine(b_lean_obj_arg ref);
+
+void optimizeModule(llvm::Module& mod, llvm::TargetMachine* tm, unsigned optLevel);
+
+//------------------------------------------------------------------------------
+// Instrumentation
+//------------------------------------------------------------------------------
+
+// The compilation phases timed by Papyrus.
+// Must be kept in sync with `Papyrus.Phase` in Lean.
+enum class Phase : uint8_t {
+	Construct,
+	Parse,
+	Verify,
+	Print,
+	WriteBitcode,
+	CreateEngine,
+	Codegen,
+	Execute,
+};
+
+#define PAPYRUS_NUM_PHASES 8
+
+// Times its lifetime as the given phase (if phase timing is enabled)
+// and records it as an event in LLVM's time trace (if the profiler is active).
+class PhaseScope {
+public:
+	PhaseScope(Phase phase);
+	PhaseScope(Phase phase, const llvm::StringRef& detail);
+	PhaseScope(const PhaseScope&) = delete;
+	~PhaseScope();
+
+	// End the scope early (does nothing if it has already ended).
+	void stop();
+
+private:
+	Phase phase;
+	bool timing;
+	// The time trace profiler the scope's event began on (if any).
+	llvm::TimeTraceProfiler* profiler;
+	uint64_t profilerGeneration;
+	double wallStart;
+	double userStart;
+	double systemStart;
+};
+
+//------------------------------------------------------------------------------
+// Array marshalling
+//------------------------------------------------------------------------------
+
+// The number of elements unpacked arrays store inline (i.e., on the stack).
+#define PAPYRUS_INLINE_ARRAY_SIZE 8
+
+// View the elements of a Lean Array (without copying them).
+static inline llvm::ArrayRef<lean_object*> viewArray(b_lean_obj_arg arr) {
+	auto arrObj = lean_to_array(arr);
+	return llvm::ArrayRef<lean_object*>(arrObj->m_data, arrObj->m_size);
+}
+
+// Covert a Lean Array of references to an LLVM SmallVector of objects.
+// Small arrays are stored inline and larger ones on the heap,
+// so arbitrarily long arrays cannot overflow the stack.
+// The result converts implicitly to an `ArrayRef`.
+template<typename T, unsigned N = PAPYRUS_INLINE_ARRAY_SIZE, typename Converter>
+llvm::SmallVector<T, N> unpackArray(b_lean_obj_arg arr, Converter convert) {
+	auto elems = viewArray(arr);
+	llvm::SmallVector<T, N> out;
+	out.reserve(elems.size());
+	for (auto elem : elems) out.push_back(convert(elem));
+	return out;
+}
 
 } // end namespace papyrus
@@ -1,24 +1,111 @@
 #pragma once
+#include "papyrus.h"
+
+#include <atomic>
 #include <lean/lean.h>
 
 namespace papyrus {
 
+//------------------------------------------------------------------------------
+// Object counters
+//------------------------------------------------------------------------------
+
+// The kinds of external objects Papyrus counts.
+// Must be kept in sync with `Papyrus.ObjectKind` in Lean.
+enum class ObjectKind : uint8_t {
+	Other,
+	Context,
+	MemoryBuffer,
+	Module,
+	Type,
+	Value,
+	GenericValue,
+	ExecutionEngine,
+};
+
+#define PAPYRUS_NUM_OBJECT_KINDS 8
+
+// The kind of external object wrapping a pointer of the template type.
+template<typename T> struct ObjectKindOf {
+	static constexpr ObjectKind kind = ObjectKind::Other;
+};
+
+template<> struct ObjectKindOf<llvm::LLVMContext> {
+	static constexpr ObjectKind kind = ObjectKind::Context;
+};
+
+template<> struct ObjectKindOf<llvm::MemoryBuffer> {
+	static constexpr ObjectKind kind = ObjectKind::MemoryBuffer;
+};
+
+template<> struct ObjectKindOf<llvm::Module> {
+	static constexpr ObjectKind kind = ObjectKind::Module;
+};
+
+template<> struct ObjectKindOf<llvm::Type> {
+	static constexpr ObjectKind kind = ObjectKind::Type;
+};
+
+template<> struct ObjectKindOf<llvm::Value> {
+	static constexpr ObjectKind kind = ObjectKind::Value;
+};
+
+template<> struct ObjectKindOf<llvm::GenericValue> {
+	static constexpr ObjectKind kind = ObjectKind::GenericValue;
+};
+
+// Process-wide counters of the objects and memory held by Papyrus.
+// They are always on, so they only use relaxed atomic operations.
+struct Counters {
+	// The number of external objects of each kind currently alive.
+	std::atomic<uint64_t> liveObjects[PAPYRUS_NUM_OBJECT_KINDS];
+	// The number of external objects of each kind ever allocated.
+	std::atomic<uint64_t> allocatedObjects[PAPYRUS_NUM_OBJECT_KINDS];
+	// The number of LLVM modules ever created (or parsed).
+	std::atomic<uint64_t> modulesCreated;
+	// The bytes currently allocated for JIT code sections.
+	std::atomic<uint64_t> jitCodeBytes;
+	// The bytes currently allocated for JIT data sections.
+	std::atomic<uint64_t> jitDataBytes;
+};
+
+extern Counters counters;
+
+// Count the allocation of an external object of the given kind.
+static inline void countObjectAlloc(ObjectKind kind) {
+	auto i = static_cast<uint8_t>(kind);
+	counters.liveObjects[i].fetch_add(1, std::memory_order_relaxed);
+	counters.allocatedObjects[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Count the finalization of an external object of the given kind.
+static inline void countObjectFree(ObjectKind kind) {
+	auto i = static_cast<uint8_t>(kind);
+	counters.liveObjects[i].fetch_sub(1, std::memory_order_relaxed);
+}
+
 //------------------------------------------------------------------------------
 // External object callbacks
 //------------------------------------------------------------------------------
 
-// A no-op finalize callback for external classes.
-static void nopFinalize(void* p) {
-  return;
+// A finalize callback for external classes that
+// only counts the finalization of an object wrapping the template type.
+template<typename T>
+void countFinalize(void* /* p */) {
+	countObjectFree(ObjectKindOf<T>::kind);
 }
 
 // A finalize callback for external classes that
 // casts the pointer to the template type and then invokes delete.
 template<typename T>
 void deleteFinalize(void* p) {
+	countObjectFree(ObjectKindOf<T>::kind);
 	delete static_cast<T*>(p);
 }
 
+// Contexts also drop the caches Papyrus keeps for them when finalized.
+template<> void deleteFinalize<llvm::LLVMContext>(void* p);
+
 // A no-op foreach callback for external classes.
 static void nopForeach(void* /* p */, b_lean_obj_arg /* a */) {
   return;
@@ -32,12 +119,13 @@ static void nopForeach(void* /* p */, b_lean_obj_arg /* a */) {
 template<typename T> static lean_external_class* getLoosePtrClass() {
 	// Use static to make this thread safe by static initialization rules.
 	static lean_external_class* k =
-    lean_register_external_class(&nopFinalize, &nopForeach);
+    lean_register_external_class(&countFinalize<T>, &nopForeach);
 	return k;
 }
 
 // Wrap a unmanaged pointer in a Lean object.
 template<typename T> lean_object* mkLoosePtr(T* ptr) {
+	countObjectAlloc(ObjectKindOf<T>::kind);
 	return lean_alloc_external(getLoosePtrClass<T>(), ptr);
 }
 
@@ -62,6 +150,7 @@ template<typename T> static lean_external_class* getOwnedPtrClass() {
 
 // Wrap an pointer in a Lean object, transfering ownership to it.
 template<typename T> lean_obj_res mkOwnedPtr(T* ptr) {
+	countObjectAlloc(ObjectKindOf<T>::kind);
 	return lean_alloc_external(getOwnedPtrClass<T>(), ptr);
 }
 
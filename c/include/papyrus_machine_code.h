@@ -0,0 +1,47 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+#include <lean/lean.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/Support/Error.h>
+
+namespace llvm {
+	class Function;
+}
+
+namespace papyrus {
+
+// The location of the machine code of a function in memory.
+struct CodeRange {
+	uint64_t addr;
+	uint64_t size;
+};
+
+// Records where a JIT loads the machine code of each function it compiles,
+// so that the code can be inspected (e.g., disassembled) afterwards.
+class CodeRecorder : public llvm::JITEventListener {
+public:
+	void notifyObjectLoaded(ObjectKey key, const llvm::object::ObjectFile& obj,
+		const llvm::RuntimeDyld::LoadedObjectInfo& info) override;
+	void notifyFreeingObject(ObjectKey key) override;
+
+	// Get the code of the function with the given (mangled) symbol name.
+	llvm::Optional<CodeRange> lookup(llvm::StringRef symbol);
+
+private:
+	// Objects may be loaded by a background compiler (e.g., of a tiered engine).
+	std::mutex mutex;
+	llvm::StringMap<CodeRange> ranges;
+	llvm::DenseMap<ObjectKey, std::vector<std::string>> symbols;
+};
+
+// Compile (if necessary) the given function of the given execution engine
+// and get the location of its machine code.
+// Fails for interpreters and for functions without code of their own.
+llvm::Expected<CodeRange> getFunctionCode(b_lean_obj_arg eeRef, llvm::Function* fn);
+
+} // end namespace papyrus
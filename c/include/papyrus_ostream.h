@@ -0,0 +1,30 @@
+#pragma once
+#include <lean/lean.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace papyrus {
+
+// An output stream that writes directly into the buffer of a Lean `String`.
+// The buffer grows geometrically and the string's UTF-8 length is tracked
+// as bytes are written, so taking the string requires no extra copy or scan.
+class LeanStringOstream : public llvm::raw_ostream {
+public:
+	explicit LeanStringOstream(size_t capacity = 1024);
+	LeanStringOstream(const LeanStringOstream&) = delete;
+	~LeanStringOstream() override;
+
+	// Take ownership of the written string.
+	// The stream must not be written to afterwards.
+	lean_obj_res take();
+
+private:
+	void write_impl(const char* ptr, size_t size) override;
+	uint64_t current_pos() const override { return size; }
+	void reserveExtra(size_t extra);
+
+	lean_object* str;
+	size_t size = 0;
+	size_t length = 0;
+};
+
+} // end namespace papyrus
@@ -1,5 +1,7 @@
 #include "papyrus.h"
+#include "papyrus_ostream.h"
 
+#include <algorithm>
 #include <lean/lean.h>
 #include <lean/lean_gmp.h>
 #include <llvm/ADT/ArrayRef.h>
@@ -45,54 +47,113 @@ llvm::StringRef refOfStringWithNull(b_lean_obj_arg str) {
   return llvm::StringRef(strObj->m_data, strObj->m_size);
 }
 
+// Start a stream writing to a new string with the given initial capacity.
+// The stream is unbuffered as it writes straight into the string's buffer.
+LeanStringOstream::LeanStringOstream(size_t capacity) : raw_ostream(true) {
+  str = lean_alloc_string(1, capacity + 1, 0);
+}
+
+LeanStringOstream::~LeanStringOstream() {
+  if (str) lean_dec_ref(str);
+}
+
+// Ensure the buffer can hold `extra` more bytes plus a null terminator.
+void LeanStringOstream::reserveExtra(size_t extra) {
+  auto capacity = lean_to_string(str)->m_capacity;
+  auto needed = size + extra + 1;
+  if (LEAN_LIKELY(needed <= capacity)) return;
+  auto newCapacity = std::max(capacity * 2, needed);
+  lean_object* newStr = lean_alloc_string(1, newCapacity, 0);
+  memcpy(lean_to_string(newStr)->m_data, lean_to_string(str)->m_data, size);
+  lean_dec_ref(str);
+  str = newStr;
+}
+
+void LeanStringOstream::write_impl(const char* ptr, size_t len) {
+  reserveExtra(len);
+  memcpy(lean_to_string(str)->m_data + size, ptr, len);
+  size += len;
+  // Count the code points by counting the bytes that start one.
+  for (size_t i = 0; i < len; i++) {
+    length += (static_cast<unsigned char>(ptr[i]) & 0xC0) != 0x80;
+  }
+}
+
+lean_obj_res LeanStringOstream::take() {
+  flush();
+  auto strObj = lean_to_string(str);
+  strObj->m_data[size] = 0;
+  strObj->m_size = size + 1;
+  strObj->m_length = length;
+  lean_object* obj = str;
+  str = nullptr;
+  return obj;
+}
+
 #define LEAN_SMALL_NAT_BITS (CHAR_BIT*sizeof(size_t)-1)
 #define LEAN_SMALL_INT_BITS (sizeof(void*) == 8 ? (CHAR_BIT*sizeof(int)-1) : 30)
 
+// GMP limbs and APInt words are copied directly between each other.
+static_assert(sizeof(mp_limb_t) == sizeof(llvm::APInt::WordType),
+  "GMP limbs must be the same size as APInt words");
+
+// The layout of a big Lean `Nat`/`Int` (i.e., `mpz_object` in Lean's runtime),
+// so that its limbs can be read directly without copying the number.
+struct LeanMpzObject {
+  lean_object m_header;
+  mpz_t m_value;
+};
+
+static inline mpz_srcptr mpzOf(b_lean_obj_arg obj) {
+  assert(lean_is_mpz(obj));
+  return reinterpret_cast<const LeanMpzObject*>(obj)->m_value;
+}
+
+// Make a big Lean number from the given words (negated if `negative`).
+// The words are viewed as a read-only GMP integer (which needs no clearing)
+// and copied only once, into the new Lean object.
+static lean_object* mkMpzFromWords
+  (const llvm::APInt::WordType* words, unsigned numWords, bool negative)
+{
+  mpz_t val;
+  mp_size_t size = numWords;
+  mpz_roinit_n(val, reinterpret_cast<mp_srcptr>(words), negative ? -size : size);
+  return lean_alloc_mpz(val);
+}
+
 lean_object* mkNatFromAP(const llvm::APInt& ap) {
   if (LEAN_LIKELY(ap.getActiveBits() <= LEAN_SMALL_NAT_BITS)) {
     return lean_box(ap.getZExtValue());
   } else {
-    mpz_t val;
-    mpz_init(val);
-    mpz_import(val, ap.getNumWords(), -1,
-      llvm::APInt::APINT_WORD_SIZE, 0, 0, ap.getRawData());
-    return lean_alloc_mpz(val);
+    return mkMpzFromWords(ap.getRawData(), ap.getActiveWords(), false);
   }
 }
 
 lean_object* mkIntFromAP(const llvm::APInt& ap) {
   if (LEAN_LIKELY(ap.getMinSignedBits() <= LEAN_SMALL_INT_BITS)) {
     return lean_box((unsigned)((int)ap.getSExtValue()));
-  } else {
-    mpz_t val;
-    mpz_init(val);
+  } else if (ap.isNegative()) {
     auto apAbs = ap.abs();
-    mpz_import(val, apAbs.getNumWords(), -1,
-      llvm::APInt::APINT_WORD_SIZE, 0, 0, apAbs.getRawData());
-    if (ap.isNegative()) mpz_neg(val, val);
-    return lean_alloc_mpz(val);
+    return mkMpzFromWords(apAbs.getRawData(), apAbs.getActiveWords(), true);
+  } else {
+    return mkMpzFromWords(ap.getRawData(), ap.getActiveWords(), false);
   }
 }
 
-llvm::APInt apNatOfMpz(unsigned numBits, const mpz_t& val) {
-  auto realNumBits = mpz_sizeinbase(val, 2);
-  auto bitsPerWord = llvm::APInt::APINT_BITS_PER_WORD;
-  size_t numWords = (realNumBits + (bitsPerWord - 1)) / bitsPerWord;
-  llvm::APInt::WordType words[numWords];
-  mpz_export(&words, nullptr, -1, llvm::APInt::APINT_WORD_SIZE, 0, 0, val);
-  llvm::ArrayRef<uint64_t> wordsRef(words, numWords);
-  return llvm::APInt(numBits, wordsRef);
+// Get the magnitude of a GMP integer truncated to `numBits`
+// by copying its limbs straight into the APInt's storage.
+static llvm::APInt apNatOfMpz(unsigned numBits, mpz_srcptr val) {
+  llvm::ArrayRef<llvm::APInt::WordType> words(
+    reinterpret_cast<const llvm::APInt::WordType*>(mpz_limbs_read(val)),
+    mpz_size(val));
+  return words.empty() ? llvm::APInt(numBits, 0) : llvm::APInt(numBits, words);
 }
 
 llvm::APInt apOfNat(unsigned numBits, b_lean_obj_arg obj) {
   if (lean_is_scalar(obj)) {
     return llvm::APInt(numBits, lean_unbox(obj), false);
   } else {
-    mpz_t val;
-    mpz_init(val);
-    assert(lean_is_mpz(obj));
-    lean_extract_mpz_value(obj, val);
-    return apNatOfMpz(numBits, val);
+    return apNatOfMpz(numBits, mpzOf(obj));
   }
 }
 
@@ -100,12 +161,10 @@ llvm::APInt apOfInt(unsigned numBits, b_lean_obj_arg obj) {
   if (lean_is_scalar(obj)) {
     return llvm::APInt(numBits, lean_scalar_to_int64(obj), true);
   } else {
-    mpz_t val;
-    mpz_init(val);
-    assert(lean_is_mpz(obj));
-    lean_extract_mpz_value(obj, val);
-    llvm::APInt apNat = apNatOfMpz(numBits, val);
-    return mpz_sgn(val) < 0 ? -apNat : apNat;
+    auto val = mpzOf(obj);
+    llvm::APInt ap = apNatOfMpz(numBits, val);
+    if (mpz_sgn(val) < 0) ap.negate();
+    return ap;
   }
 }
 
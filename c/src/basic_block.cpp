@@ -3,6 +3,8 @@
 
 #include <lean/lean.h>
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Function.h>
 
 using namespace llvm;
 
@@ -43,4 +45,94 @@ extern "C" lean_obj_res papyrus_basic_block_append_instruction
 	return lean_io_result_mk_ok(lean_box(0));
 }
 
+// Get the terminator of the given basic block (if it has one).
+extern "C" lean_obj_res papyrus_basic_block_get_terminator
+	(b_lean_obj_arg bbRef, lean_obj_arg /* w */)
+{
+	auto term = toBasicBlock(bbRef)->getTerminator();
+	auto obj = term ? mkSome(mkValueRef(copyLink(bbRef), term)) : lean_box(0);
+	return lean_io_result_mk_ok(obj);
+}
+
+// Split the given basic block in two at the given instruction.
+// The instruction and those after it are moved to a new block
+// (inserted after the original), which the original unconditionally
+// branches to. Returns the new block.
+extern "C" lean_obj_res papyrus_basic_block_split
+	(b_lean_obj_arg instRef, b_lean_obj_arg nameObj, b_lean_obj_arg bbRef,
+		lean_obj_arg /* w */)
+{
+	auto bb = toBasicBlock(bbRef);
+	auto inst = toInstruction(instRef);
+	if (inst->getParent() != bb) return mkStringError("Instruction is not in the basic block.");
+	if (!bb->getTerminator()) return mkStringError("Basic block has no terminator.");
+	auto tail = bb->splitBasicBlock(inst, refOfString(nameObj));
+	return lean_io_result_mk_ok(mkValueRef(copyLink(bbRef), tail));
+}
+
+// Move the given basic block (which may be unlinked) right before another
+// (possibly into another function).
+extern "C" lean_obj_res papyrus_basic_block_move_before
+	(b_lean_obj_arg bbRef, b_lean_obj_arg posRef, lean_obj_arg /* w */)
+{
+	auto bb = toBasicBlock(bbRef);
+	auto pos = toBasicBlock(posRef);
+	if (bb == pos) return mkStringError("Cannot move a basic block relative to itself.");
+	if (!pos->getParent()) return mkStringError("Position is not in a function.");
+	if (bb->getParent()) bb->moveBefore(pos); else bb->insertInto(pos->getParent(), pos);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Move the given basic block (which may be unlinked) right after another
+// (possibly into another function).
+extern "C" lean_obj_res papyrus_basic_block_move_after
+	(b_lean_obj_arg bbRef, b_lean_obj_arg posRef, lean_obj_arg /* w */)
+{
+	auto bb = toBasicBlock(bbRef);
+	auto pos = toBasicBlock(posRef);
+	if (bb == pos) return mkStringError("Cannot move a basic block relative to itself.");
+	if (!pos->getParent()) return mkStringError("Position is not in a function.");
+	if (bb->getParent()) {
+		bb->moveAfter(pos);
+	} else {
+		bb->insertInto(pos->getParent(), pos->getNextNode());
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Unlink the given basic block from its function without deleting it.
+extern "C" lean_obj_res papyrus_basic_block_remove_from_parent
+	(b_lean_obj_arg bbRef, lean_obj_arg /* w */)
+{
+	auto bb = toBasicBlock(bbRef);
+	if (!bb->getParent()) return mkStringError("Basic block is not in a function.");
+	bb->removeFromParent();
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Unlink the given basic block (which no branch may target)
+// from its function and delete it along with its instructions.
+// The instructions may only be used within the block itself.
+// The block's entries in the PHIs of its successors are removed.
+extern "C" lean_obj_res papyrus_basic_block_erase_from_parent
+	(b_lean_obj_arg bbRef, lean_obj_arg /* w */)
+{
+	auto bb = toBasicBlock(bbRef);
+	if (!bb->getParent()) return mkStringError("Basic block is not in a function.");
+	if (!bb->use_empty()) return mkStringError("Basic block still has uses.");
+	for (auto& inst : *bb) {
+		for (auto user : inst.users()) {
+			if (cast<Instruction>(user)->getParent() != bb) {
+				return mkStringError("Instruction in the basic block is used outside of it.");
+			}
+		}
+	}
+	// PHI incoming blocks are not uses, so they must be removed explicitly
+	// (the PHIs themselves are kept, as they may still be referenced)
+	for (auto succ : successors(bb)) succ->removePredecessor(bb, true);
+	bb->dropAllReferences();
+	bb->eraseFromParent();
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
 } // end namespace papyrus
@@ -1,8 +1,12 @@
 #include "papyrus.h"
+#include "papyrus_ffi.h"
 
 #include <lean/lean.h>
 #include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
 
 using namespace llvm;
 
@@ -12,6 +16,7 @@ extern "C" lean_obj_res papyrus_module_write_bitcode_to_file
 	(b_lean_obj_res fnameObj, b_lean_obj_res modObj, uint8_t perserveOrder,
 		lean_obj_arg /* w */)
 {
+	PhaseScope phase(Phase::WriteBitcode, refOfString(fnameObj));
 	std::error_code ec;
 	raw_fd_ostream out(refOfString(fnameObj), ec);
 	if (ec) return lean_decode_io_error(ec.value(), fnameObj);
@@ -19,11 +24,24 @@ extern "C" lean_obj_res papyrus_module_write_bitcode_to_file
 	return lean_io_result_mk_ok(lean_box(0));
 }
 
-extern "C" lean_obj_res papyrus_module_parse_bitcode_from_buffer
-(b_lean_obj_res bufObj, lean_obj_arg ctxObj, lean_obj_arg /* w */)
+// Write the bitcode of the given module to a Lean ByteArray.
+extern "C" lean_obj_res papyrus_module_write_bitcode_to_byte_array
+	(b_lean_obj_res modObj, uint8_t perserveOrder, lean_obj_arg /* w */)
 {
+	auto mod = toModule(modObj);
+	PhaseScope phase(Phase::WriteBitcode, mod->getModuleIdentifier());
+	SmallVector<char, 0> buf;
+	raw_svector_ostream out(buf);
+	llvm::WriteBitcodeToFile(*mod, out, perserveOrder);
+	lean_object* bytes = lean_alloc_sarray(1, buf.size(), buf.size());
+	memcpy(lean_sarray_cptr(bytes), buf.data(), buf.size());
+	return lean_io_result_mk_ok(bytes);
+}
+
+// Parse a module from the given bitcode in the given context.
+static lean_obj_res parseBitcode(MemoryBufferRef buf, lean_obj_arg ctxObj) {
 	auto ctx = toLLVMContext(ctxObj);
-	MemoryBufferRef buf = toMemoryBuffer(bufObj)->getMemBufferRef();
+	PhaseScope phase(Phase::Parse, buf.getBufferIdentifier());
 	Expected<std::unique_ptr<Module>> moduleOrErr = llvm::parseBitcodeFile(buf, *ctx);
 	if (!moduleOrErr) {
 		lean_dec_ref(ctxObj);
@@ -33,7 +51,41 @@ extern "C" lean_obj_res papyrus_module_parse_bitcode_from_buffer
 		});
 		return mkStdStringError(errMsg);
 	}
+	counters.modulesCreated.fetch_add(1, std::memory_order_relaxed);
 	return lean_io_result_mk_ok(mkModuleRef(ctxObj, moduleOrErr.get().release()));
 }
 
+extern "C" lean_obj_res papyrus_module_parse_bitcode_from_buffer
+(b_lean_obj_res bufObj, lean_obj_arg ctxObj, lean_obj_arg /* w */)
+{
+	return parseBitcode(toMemoryBuffer(bufObj)->getMemBufferRef(), ctxObj);
+}
+
+// Parse a module from the bitcode in a Lean ByteArray.
+// The module does not reference the array once parsed.
+extern "C" lean_obj_res papyrus_module_parse_bitcode_from_byte_array
+(b_lean_obj_res bytesObj, b_lean_obj_res nameObj, lean_obj_arg ctxObj,
+	lean_obj_arg /* w */)
+{
+	auto data = reinterpret_cast<const char*>(lean_sarray_cptr(bytesObj));
+	auto buf = MemoryBufferRef(StringRef(data, lean_sarray_size(bytesObj)),
+		refOfString(nameObj));
+	return parseBitcode(buf, ctxObj);
+}
+
+// Parse a module from bitcode encoded as a string of hexadecimal digits
+// (two per byte), the compact form precompiled modules embed their bitcode in.
+extern "C" lean_obj_res papyrus_module_parse_bitcode_from_hex
+(b_lean_obj_res hexObj, b_lean_obj_res nameObj, lean_obj_arg ctxObj,
+	lean_obj_arg /* w */)
+{
+	auto hex = refOfString(hexObj);
+	if (hex.size() % 2 != 0 || !all_of(hex, isHexDigit)) {
+		lean_dec_ref(ctxObj);
+		return mkStringError("Bitcode is not a string of hexadecimal byte values.");
+	}
+	auto bytes = fromHex(hex);
+	return parseBitcode(MemoryBufferRef(bytes, refOfString(nameObj)), ctxObj);
+}
+
 } // end namespace lean_llvm
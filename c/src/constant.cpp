@@ -3,6 +3,9 @@
 
 #include <lean/lean.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Error.h>
 
 using namespace llvm;
 
@@ -141,6 +144,84 @@ extern "C" lean_obj_res papyrus_get_constant_int_of_type
 	return lean_io_result_mk_ok(mkConstantRef(ctxObj, n));
 }
 
+// Get the integer constants of the given type with the values of a Lean array,
+// converting each value with the given function.
+template<APInt (*ToAP)(unsigned, b_lean_obj_arg)>
+static void getConstantInts
+	(b_lean_obj_res valsObj, IntegerType* type, SmallVectorImpl<Constant*>& out)
+{
+	auto vals = lean_to_array(valsObj);
+	auto numBits = type->getBitWidth();
+	auto& ctx = type->getContext();
+	out.reserve(vals->m_size);
+	for (size_t i = 0; i < vals->m_size; i++) {
+		out.push_back(ConstantInt::get(ctx, ToAP(numBits, vals->m_data[i])));
+	}
+}
+
+// Get an array of references to the constants of the given type
+// with the values of a Lean array (converted with the given function).
+template<APInt (*ToAP)(unsigned, b_lean_obj_arg)>
+static lean_obj_res getConstantIntRefs
+	(b_lean_obj_res valsObj, b_lean_obj_res typeRef)
+{
+	SmallVector<Constant*, 16> consts;
+	getConstantInts<ToAP>(valsObj, toIntegerType(typeRef), consts);
+	auto ctxRef = borrowLink(typeRef);
+	lean_object* arr = lean_alloc_array(consts.size(), consts.size());
+	auto arrObj = lean_to_array(arr);
+	for (size_t i = 0; i < consts.size(); i++) {
+		lean_inc_ref(ctxRef);
+		arrObj->m_data[i] = mkConstantRef(ctxRef, consts[i]);
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+// Get a reference to a constant array of the given element type
+// with the values of a Lean array (converted with the given function).
+template<APInt (*ToAP)(unsigned, b_lean_obj_arg)>
+static lean_obj_res getConstantIntArray
+	(b_lean_obj_res valsObj, b_lean_obj_res typeRef)
+{
+	SmallVector<Constant*, 16> consts;
+	auto type = toIntegerType(typeRef);
+	getConstantInts<ToAP>(valsObj, type, consts);
+	auto k = ConstantArray::get(ArrayType::get(type, consts.size()), consts);
+	return lean_io_result_mk_ok(mkConstantRef(copyLink(typeRef), k));
+}
+
+// Get references to constants of the given type with the given Nat values
+// (truncated and/or extended as necessary) in one call.
+extern "C" lean_obj_res papyrus_get_constant_nats_of_type
+	(b_lean_obj_res valsObj, b_lean_obj_res typeRef, lean_obj_arg /* w */)
+{
+	return getConstantIntRefs<apOfNat>(valsObj, typeRef);
+}
+
+// Get references to constants of the given type with the given Int values
+// (truncated and/or extended as necessary) in one call.
+extern "C" lean_obj_res papyrus_get_constant_ints_of_type
+	(b_lean_obj_res valsObj, b_lean_obj_res typeRef, lean_obj_arg /* w */)
+{
+	return getConstantIntRefs<apOfInt>(valsObj, typeRef);
+}
+
+// Get a reference to a constant array of the given Nat values
+// as integers of the given type.
+extern "C" lean_obj_res papyrus_get_constant_array_of_nats
+	(b_lean_obj_res valsObj, b_lean_obj_res typeRef, lean_obj_arg /* w */)
+{
+	return getConstantIntArray<apOfNat>(valsObj, typeRef);
+}
+
+// Get a reference to a constant array of the given Int values
+// as integers of the given type.
+extern "C" lean_obj_res papyrus_get_constant_array_of_ints
+	(b_lean_obj_res valsObj, b_lean_obj_res typeRef, lean_obj_arg /* w */)
+{
+	return getConstantIntArray<apOfInt>(valsObj, typeRef);
+}
+
 // Get the Nat value of the given integer constant.
 extern "C" lean_obj_res papyrus_constant_int_get_nat_value
 	(b_lean_obj_res constRef, lean_obj_arg /* w */)
@@ -159,16 +240,57 @@ extern "C" lean_obj_res papyrus_constant_int_get_int_value
 // Constant Data Arrays
 //------------------------------------------------------------------------------
 
-// Get the LLVM ConstantDataSequential pointer wrapped in an object.
-ConstantDataSequential* toConstantDataSequential(lean_object* ref) {
-	return llvm::cast<ConstantDataSequential>(toValue(ref));
+// Get the element type of an array or (fixed) vector type.
+static Type* getSequentialElementType(Type* type) {
+	if (auto arrTy = dyn_cast<ArrayType>(type)) return arrTy->getElementType();
+	return cast<FixedVectorType>(type)->getElementType();
+}
+
+// Get the LLVM ConstantDataSequential pointer wrapped in an object,
+// or null if it is a zero aggregate of an array or vector type
+// whose elements could be constant data, which LLVM uniques
+// all-zero constant data to (e.g., that of `ofBytes`).
+// Any other kind of constant is an error.
+static Expected<ConstantDataSequential*> toConstantDataSequential(lean_object* ref) {
+	auto k = toValue(ref);
+	if (auto cds = dyn_cast<ConstantDataSequential>(k)) {
+		return cds;
+	}
+	auto type = k->getType();
+	if (isa<ConstantAggregateZero>(k) &&
+		(type->isArrayTy() || isa<FixedVectorType>(type)) &&
+		ConstantDataSequential::isElementTypeCompatible(getSequentialElementType(type)))
+	{
+		return nullptr;
+	}
+	return createStringError(inconvertibleErrorCode(),
+		"Constant is not a constant data array or vector.");
+}
+
+// Get the number of elements of an array or (fixed) vector type.
+static uint64_t getSequentialNumElements(Type* type) {
+	if (auto arrTy = dyn_cast<ArrayType>(type)) return arrTy->getNumElements();
+	return cast<FixedVectorType>(type)->getNumElements();
+}
+
+// Get the raw bytes of the elements of a constant data array or vector
+// (or of a zero aggregate of one, which are all zero).
+static std::string getSequentialRawData(b_lean_obj_arg constRef, ConstantDataSequential* cds) {
+	if (cds) return cds->getRawDataValues().str();
+	auto type = toValue(constRef)->getType();
+	auto elemSize = getSequentialElementType(type)->getPrimitiveSizeInBits() / 8;
+	return std::string(getSequentialNumElements(type) * elemSize, '\0');
 }
 
 // Get whether this constant is a string.
 extern "C" lean_obj_res papyrus_constant_data_sequential_is_string
 	(b_lean_obj_res constRef,  lean_obj_arg /* w */)
 {
-	auto b = toConstantDataSequential(constRef)->isString();
+	auto cdsOrErr = toConstantDataSequential(constRef);
+	if (!cdsOrErr) return mkStdStringError(toString(cdsOrErr.takeError()));
+	if (auto cds = *cdsOrErr) return lean_io_result_mk_ok(lean_box(cds->isString()));
+	auto type = toValue(constRef)->getType();
+	auto b = type->isArrayTy() && type->getArrayElementType()->isIntegerTy(8);
 	return lean_io_result_mk_ok(lean_box(b));
 }
 
@@ -176,8 +298,9 @@ extern "C" lean_obj_res papyrus_constant_data_sequential_is_string
 extern "C" lean_obj_res papyrus_constant_data_sequential_get_as_string
 	(b_lean_obj_res constRef, uint8_t withNull, lean_obj_arg /* w */)
 {
-	auto str = toConstantDataSequential(constRef)->getRawDataValues();
-	return lean_io_result_mk_ok(mkStringFromRef(str));
+	auto cdsOrErr = toConstantDataSequential(constRef);
+	if (!cdsOrErr) return mkStdStringError(toString(cdsOrErr.takeError()));
+	return lean_io_result_mk_ok(mkStringFromStd(getSequentialRawData(constRef, *cdsOrErr)));
 }
 
 // Get a reference to a (UTF-8 encoded) string constant.
@@ -189,6 +312,150 @@ extern "C" lean_obj_res papyrus_get_constant_string
 	return lean_io_result_mk_ok(mkConstantRef(ctxObj, cnst));
 }
 
+// Get the raw bytes of the elements of a constant (in host byte order).
+extern "C" lean_obj_res papyrus_constant_data_sequential_get_raw_data
+	(b_lean_obj_res constRef, lean_obj_arg /* w */)
+{
+	auto cdsOrErr = toConstantDataSequential(constRef);
+	if (!cdsOrErr) return mkStdStringError(toString(cdsOrErr.takeError()));
+	auto data = getSequentialRawData(constRef, *cdsOrErr);
+	lean_object* bytes = lean_alloc_sarray(1, data.size(), data.size());
+	memcpy(lean_sarray_cptr(bytes), data.data(), data.size());
+	return lean_io_result_mk_ok(bytes);
+}
+
+// Get the number of elements of a constant.
+extern "C" lean_obj_res papyrus_constant_data_sequential_get_num_elements
+	(b_lean_obj_res constRef, lean_obj_arg /* w */)
+{
+	auto cdsOrErr = toConstantDataSequential(constRef);
+	if (!cdsOrErr) return mkStdStringError(toString(cdsOrErr.takeError()));
+	auto n = getSequentialNumElements(toValue(constRef)->getType());
+	return lean_io_result_mk_ok(lean_box_uint64(n));
+}
+
+// Get a constant data array (or vector) of the given elements.
+template<typename T>
+static Constant* getConstantData
+	(LLVMContext& ctx, ArrayRef<T> elems, bool isVector)
+{
+	return isVector ? ConstantDataVector::get(ctx, elems) :
+		ConstantDataArray::get(ctx, elems);
+}
+
+// Get a constant data array (or vector) of floating point elements
+// of the given type from their bit patterns.
+template<typename T>
+static Constant* getConstantDataFP
+	(Type* elemType, ArrayRef<T> elems, bool isVector)
+{
+	return isVector ? ConstantDataVector::getFP(elemType, elems) :
+		ConstantDataArray::getFP(elemType, elems);
+}
+
+// Reinterpret raw bytes (in host byte order) as an array of elements.
+template<typename T>
+static ArrayRef<T> elemsOfBytes(const uint8_t* data, size_t size) {
+	return makeArrayRef(reinterpret_cast<const T*>(data), size / sizeof(T));
+}
+
+// Get a constant data array (or vector) with elements of the given type
+// from their raw bytes (in host byte order). Elements may be 8, 16, 32, or 64
+// bit integers or half, bfloat, float, or double floating point values.
+// Note that LLVM returns a zero aggregate instead if all bytes are zero.
+extern "C" lean_obj_res papyrus_get_constant_data_of_bytes
+	(b_lean_obj_res bytesObj, b_lean_obj_res elemTypeRef, uint8_t isVector,
+		lean_obj_arg /* w */)
+{
+	auto elemType = toType(elemTypeRef);
+	if (!ConstantDataSequential::isElementTypeCompatible(elemType)) {
+		return mkStringError("Element type is not supported by constant data.");
+	}
+	auto data = lean_sarray_cptr(bytesObj);
+	auto size = lean_sarray_size(bytesObj);
+	auto elemSize = elemType->getScalarSizeInBits() / 8;
+	if (size % elemSize != 0) {
+		return mkStringError("Byte array size is not a multiple of the element size.");
+	}
+	auto& ctx = elemType->getContext();
+	Constant* k;
+	if (elemType->isIntegerTy()) {
+		switch (elemSize) {
+		case 1: k = getConstantData(ctx, elemsOfBytes<uint8_t>(data, size), isVector); break;
+		case 2: k = getConstantData(ctx, elemsOfBytes<uint16_t>(data, size), isVector); break;
+		case 4: k = getConstantData(ctx, elemsOfBytes<uint32_t>(data, size), isVector); break;
+		default: k = getConstantData(ctx, elemsOfBytes<uint64_t>(data, size), isVector); break;
+		}
+	} else {
+		switch (elemSize) {
+		case 2: k = getConstantDataFP(elemType, elemsOfBytes<uint16_t>(data, size), isVector); break;
+		case 4: k = getConstantDataFP(elemType, elemsOfBytes<uint32_t>(data, size), isVector); break;
+		default: k = getConstantDataFP(elemType, elemsOfBytes<uint64_t>(data, size), isVector); break;
+		}
+	}
+	return lean_io_result_mk_ok(mkConstantRef(copyLink(elemTypeRef), k));
+}
+
+// Get a constant data array (or vector) of doubles (or floats, if `single`)
+// from a Lean `FloatArray`.
+extern "C" lean_obj_res papyrus_get_constant_data_of_float_array
+	(b_lean_obj_res floatsObj, uint8_t single, uint8_t isVector,
+		lean_obj_arg ctxRef, lean_obj_arg /* w */)
+{
+	auto& ctx = *toLLVMContext(ctxRef);
+	auto doubles = makeArrayRef(lean_float_array_cptr(floatsObj),
+		lean_sarray_size(floatsObj));
+	Constant* k;
+	if (single) {
+		SmallVector<float, 64> floats(doubles.begin(), doubles.end());
+		k = getConstantData<float>(ctx, floats, isVector);
+	} else {
+		k = getConstantData(ctx, doubles, isVector);
+	}
+	return lean_io_result_mk_ok(mkConstantRef(ctxRef, k));
+}
+
+// Get a constant data array (or vector) of integers
+// from a Lean array of boxed fixed-width words.
+template<typename T, T (*Unbox)(b_lean_obj_arg)>
+static lean_obj_res getConstantDataOfWords
+	(b_lean_obj_res arrObj, uint8_t isVector, lean_obj_arg ctxRef)
+{
+	auto arr = lean_to_array(arrObj);
+	SmallVector<T, 64> elems;
+	elems.reserve(arr->m_size);
+	for (size_t i = 0; i < arr->m_size; i++) {
+		elems.push_back(Unbox(arr->m_data[i]));
+	}
+	auto k = getConstantData<T>(*toLLVMContext(ctxRef), elems, isVector);
+	return lean_io_result_mk_ok(mkConstantRef(ctxRef, k));
+}
+
+static inline uint16_t unboxUInt16(b_lean_obj_arg o) {
+	return static_cast<uint16_t>(lean_unbox(o));
+}
+
+// Get a constant data array (or vector) of i16s from an `Array UInt16`.
+extern "C" lean_obj_res papyrus_get_constant_data_of_uint16_array
+	(b_lean_obj_res arrObj, uint8_t isVector, lean_obj_arg ctxRef, lean_obj_arg /* w */)
+{
+	return getConstantDataOfWords<uint16_t, unboxUInt16>(arrObj, isVector, ctxRef);
+}
+
+// Get a constant data array (or vector) of i32s from an `Array UInt32`.
+extern "C" lean_obj_res papyrus_get_constant_data_of_uint32_array
+	(b_lean_obj_res arrObj, uint8_t isVector, lean_obj_arg ctxRef, lean_obj_arg /* w */)
+{
+	return getConstantDataOfWords<uint32_t, lean_unbox_uint32>(arrObj, isVector, ctxRef);
+}
+
+// Get a constant data array (or vector) of i64s from an `Array UInt64`.
+extern "C" lean_obj_res papyrus_get_constant_data_of_uint64_array
+	(b_lean_obj_res arrObj, uint8_t isVector, lean_obj_arg ctxRef, lean_obj_arg /* w */)
+{
+	return getConstantDataOfWords<uint64_t, lean_unbox_uint64>(arrObj, isVector, ctxRef);
+}
+
 //------------------------------------------------------------------------------
 // Constant Expressions
 //------------------------------------------------------------------------------
@@ -198,7 +465,7 @@ extern "C" lean_obj_res papyrus_constant_expr_get_element_ptr
 	(b_lean_obj_res aggRef, b_lean_obj_res indicesObj, uint8_t inBounds,
 		lean_obj_arg /* w */)
 {
-	LEAN_ARRAY_TO_REF(Constant*, toConstant, indicesObj, indices);
+	auto indices = unpackArray<Constant*>(indicesObj, toConstant);
 	auto k = ConstantExpr::getGetElementPtr(nullptr, toConstant(aggRef),
 		indices, inBounds);
 	return lean_io_result_mk_ok(mkConstantRef(getValueContext(aggRef), k));
@@ -209,7 +476,7 @@ extern "C" lean_obj_res papyrus_constant_expr_get_element_ptr_in_range
 	(b_lean_obj_res aggRef, b_lean_obj_res indicesObj, uint32_t inRange,
 		uint8_t inBounds, lean_obj_arg /* w */)
 {
-	LEAN_ARRAY_TO_REF(Constant*, toConstant, indicesObj, indices);
+	auto indices = unpackArray<Constant*>(indicesObj, toConstant);
 	auto k = ConstantExpr::getGetElementPtr(nullptr, toConstant(aggRef),
 		indices, inBounds, inRange);
 	return lean_io_result_mk_ok(mkConstantRef(getValueContext(aggRef), k));
@@ -18,6 +18,15 @@ LLVMContext* toLLVMContext(lean_object* ref) {
 	return fromOwnedPtr<LLVMContext>(ref);
 }
 
+// Finalize a Lean LLVM Context object,
+// dropping the caches Papyrus keeps for the context along with it.
+template<> void deleteFinalize<LLVMContext>(void* p) {
+	countObjectFree(ObjectKind::Context);
+	auto ctx = static_cast<LLVMContext*>(p);
+	forgetLoweredTypes(ctx);
+	delete ctx;
+}
+
 // Create a new Lean LLVM Context object.
 extern "C" lean_obj_res papyrus_context_new(lean_obj_arg /* w */) {
 	return lean_io_result_mk_ok(mkContextRef(new LLVMContext()));
@@ -0,0 +1,48 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+
+#include <lean/lean.h>
+#include <llvm/Support/Process.h>
+
+using namespace llvm;
+
+namespace papyrus {
+
+Counters counters;
+
+// Get an array of the live and allocated counts
+// of each kind of external object (indexed by kind).
+extern "C" lean_obj_res papyrus_counters_get_object_counts(lean_obj_arg /* w */) {
+	size_t len = PAPYRUS_NUM_OBJECT_KINDS;
+	lean_object* arr = lean_alloc_array(len, len);
+	lean_array_object* arrObj = lean_to_array(arr);
+	for (size_t i = 0; i < len; i++) {
+		lean_object* obj = lean_alloc_ctor(0, 0, 2*sizeof(uint64_t));
+		lean_ctor_set_uint64(obj, 0,
+			counters.liveObjects[i].load(std::memory_order_relaxed));
+		lean_ctor_set_uint64(obj, sizeof(uint64_t),
+			counters.allocatedObjects[i].load(std::memory_order_relaxed));
+		arrObj->m_data[i] = obj;
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+// Get the number of LLVM modules ever created (or parsed) by Papyrus.
+extern "C" lean_obj_res papyrus_counters_get_modules_created(lean_obj_arg /* w */) {
+	auto n = counters.modulesCreated.load(std::memory_order_relaxed);
+	return lean_io_result_mk_ok(lean_box_uint64(n));
+}
+
+// Get the memory currently in use by the process' allocator
+// and by the code and data sections of JIT compiled modules.
+extern "C" lean_obj_res papyrus_counters_get_memory_usage(lean_obj_arg /* w */) {
+	lean_object* obj = lean_alloc_ctor(0, 0, 3*sizeof(uint64_t));
+	lean_ctor_set_uint64(obj, 0, sys::Process::GetMallocUsage());
+	lean_ctor_set_uint64(obj, sizeof(uint64_t),
+		counters.jitCodeBytes.load(std::memory_order_relaxed));
+	lean_ctor_set_uint64(obj, 2*sizeof(uint64_t),
+		counters.jitDataBytes.load(std::memory_order_relaxed));
+	return lean_io_result_mk_ok(obj);
+}
+
+} // end namespace papyrus
@@ -1,9 +1,26 @@
 #include "papyrus.h"
 #include "papyrus_ffi.h"
+#include "papyrus_machine_code.h"
 
+#include <algorithm>
+#include <mutex>
+#include <thread>
 #include <lean/lean.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/FunctionComparator.h>
 
 using namespace llvm;
 
@@ -20,31 +37,137 @@ struct EEExternal {
 	// The error message owned by the execution engine.
 	std::string* errMsg;
 
+	// Whether the engine shares compiled functions through the JIT function cache.
+	bool shareFunctions = false;
+
+	// The number of modules whose functions have been published to the cache.
+	size_t numPublished = 0;
+
+	// The number of function definitions replaced by previously compiled code.
+	uint64_t numReused = 0;
+
+	// Private copies of the modules in which the engine reuses functions
+	// (keyed by the module they copy), which the engine compiles instead,
+	// so that the modules held by Lean keep their definitions.
+	DenseMap<Module*, Module*> privateModules;
+
+	// The functions of the private copies (keyed by the function they copy).
+	DenseMap<const Function*, Function*> privateFunctions;
+
+	// Engines whose compiled code this engine calls.
+	// They are kept alive for as long as this engine is.
+	SmallVector<EEExternal*, 2> providers;
+
+	// References to this engine (from Lean and from the engines it provides for).
+	std::atomic<unsigned> refs{1};
+
+	// Where the engine loaded its compiled code (null for interpreters).
+	// It must outlive the engine, which reports freeing the code.
+	std::unique_ptr<CodeRecorder> code;
+
 	EEExternal(ExecutionEngine* ee, std::string* errMsg)
-		: ee(ee), errMsg(errMsg) {}
+		: ee(ee), errMsg(errMsg)
+	{
+		if (ee->getTargetMachine()) {
+			code = std::make_unique<CodeRecorder>();
+			ee->RegisterJITEventListener(code.get());
+		}
+	}
 
   EEExternal(const EEExternal&) = delete;
 
 	~EEExternal() {
     // remove all the modules from the execution engine so they don't get deleted
 		for (auto it = modules.begin(), end = modules.end(); it != end; ++it) {
-      ee->removeModule(*it);
+      ee->removeModule(getEngineModule(*it));
     }
     delete ee;
     delete errMsg;
+		for (auto& entry : privateModules) delete entry.second;
+	}
+
+	// Get the module the engine compiles for the given module
+	// (its private copy, if it has one).
+	Module* getEngineModule(Module* mod) const {
+		auto it = privateModules.find(mod);
+		return it == privateModules.end() ? mod : it->second;
+	}
+
+	// Get the function the engine compiles for the given function
+	// (its private copy, if it has one).
+	Function* getEngineFunction(Function* fn) const {
+		auto it = privateFunctions.find(fn);
+		return it == privateFunctions.end() ? fn : it->second;
+	}
+};
+
+void unpublishFunctions(EEExternal* eee, Module* mod = nullptr);
+void finalizeEngine(EEExternal* eee);
+
+// Drop a reference to an engine, deleting it once none remain.
+static void releaseEngine(EEExternal* eee) {
+	if (eee->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+	unpublishFunctions(eee);
+	auto providers = std::move(eee->providers);
+	delete eee;
+	for (auto provider : providers) releaseEngine(provider);
+}
+
+// Finalize the Lean reference to an engine.
+static void finalizeEngineRef(void* p) {
+	countObjectFree(ObjectKind::ExecutionEngine);
+	releaseEngine(static_cast<EEExternal*>(p));
+}
+
+template<> struct ObjectKindOf<EEExternal> {
+	static constexpr ObjectKind kind = ObjectKind::ExecutionEngine;
+};
+
+// An MCJIT memory manager that counts the bytes of the sections it allocates.
+class CountingMemoryManager : public SectionMemoryManager {
+public:
+	CountingMemoryManager() {}
+	CountingMemoryManager(const CountingMemoryManager&) = delete;
+
+	~CountingMemoryManager() override {
+		counters.jitCodeBytes.fetch_sub(codeBytes, std::memory_order_relaxed);
+		counters.jitDataBytes.fetch_sub(dataBytes, std::memory_order_relaxed);
+	}
+
+	uint8_t* allocateCodeSection(uintptr_t size, unsigned alignment,
+		unsigned sectionID, StringRef sectionName) override
+	{
+		codeBytes += size;
+		counters.jitCodeBytes.fetch_add(size, std::memory_order_relaxed);
+		return SectionMemoryManager::allocateCodeSection(
+			size, alignment, sectionID, sectionName);
+	}
+
+	uint8_t* allocateDataSection(uintptr_t size, unsigned alignment,
+		unsigned sectionID, StringRef sectionName, bool isReadOnly) override
+	{
+		dataBytes += size;
+		counters.jitDataBytes.fetch_add(size, std::memory_order_relaxed);
+		return SectionMemoryManager::allocateDataSection(
+			size, alignment, sectionID, sectionName, isReadOnly);
 	}
+
+private:
+	uint64_t codeBytes = 0;
+	uint64_t dataBytes = 0;
 };
 
 // Lean object class for an LLVM ExecutionEngine.
 static lean_external_class* getExecutionEngineClass() {
 	// Use static to make this thread safe by static initialization rules.
   static lean_external_class* c =
-    lean_register_external_class(&deleteFinalize<EEExternal>, &nopForeach);
+    lean_register_external_class(&finalizeEngineRef, &nopForeach);
 	return c;
 }
 
 // Wrap a ExecutionEngine in a Lean object.
 lean_object* mkExecutionEngineRef(EEExternal* ee) {
+	countObjectAlloc(ObjectKind::ExecutionEngine);
 	return lean_alloc_external(getExecutionEngineClass(), ee);
 }
 
@@ -55,11 +178,171 @@ EEExternal* toEEExternal(lean_object* eeRef) {
 	return static_cast<EEExternal*>(external->m_data);
 }
 
+// Get where the engine loaded the machine code of the given function,
+// compiling (and relocating) the function's module if it has not been yet.
+Expected<CodeRange> getFunctionCode(b_lean_obj_arg eeRef, Function* fn) {
+	auto eee = toEEExternal(eeRef);
+	fn = eee->getEngineFunction(fn);
+	if (!eee->code) {
+		return createStringError(inconvertibleErrorCode(),
+			"Execution engine does not compile to machine code.");
+	}
+	if (fn->isDeclaration()) {
+		return createStringError(inconvertibleErrorCode(),
+			"Function has no code of its own in the execution engine.");
+	}
+	// Compile the function's module if it has not been yet
+	if (!eee->ee->getPointerToFunction(fn)) {
+		return createStringError(inconvertibleErrorCode(),
+			"Function is not in the execution engine.");
+	}
+	// Loading the code does not relocate it, so finalize the engine
+	// to resolve the targets of calls and RIP-relative operands
+	finalizeEngine(eee);
+	SmallString<128> symbol;
+	Mangler().getNameWithPrefix(symbol, fn, false);
+	if (auto range = eee->code->lookup(symbol)) {
+		return *range;
+	}
+	return createStringError(inconvertibleErrorCode(),
+		"Machine code of the function was not recorded.");
+}
+
 // Get the ExecutionEngine wrapped in an object.
 ExecutionEngine* toExecutionEngine(lean_object* eeRef) {
 	return toEEExternal(eeRef)->ee;
 }
 
+//------------------------------------------------------------------------------
+// JIT function cache
+//------------------------------------------------------------------------------
+
+// A compiled function whose code can be shared with other engines.
+struct SharedFunction {
+	Function* fn;
+	uint64_t addr;
+	EEExternal* owner;
+};
+
+// Compiled functions of live engines keyed by `FunctionComparator` hash.
+static std::mutex sharedFunctionsMutex;
+static DenseMap<uint64_t, SmallVector<SharedFunction, 1>> sharedFunctions;
+
+// Whether a function definition references no global values
+// (other functions, global variables, or itself).
+// `FunctionComparator` tells globals apart by identity, so only such
+// self-contained functions can be matched across modules.
+static bool isSelfContained(const Function& fn) {
+	if (fn.hasPersonalityFn() || fn.hasPrefixData() || fn.hasPrologueData()) {
+		return false;
+	}
+	for (auto& bb : fn) {
+		for (auto& inst : bb) {
+			for (auto& op : inst.operands()) {
+				if (auto k = dyn_cast<Constant>(op.get())) {
+					if (!isa<ConstantData>(k)) return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Record the compiled functions of the engine's newly compiled modules
+// in the cache. Only non-local functions have symbols to look up.
+static void publishFunctions(EEExternal* eee) {
+	if (!eee->shareFunctions) return;
+	std::lock_guard<std::mutex> lock(sharedFunctionsMutex);
+	for (; eee->numPublished < eee->modules.size(); eee->numPublished++) {
+		for (auto& fn : *eee->getEngineModule(eee->modules[eee->numPublished])) {
+			if (fn.isDeclaration() || fn.hasLocalLinkage() || !isSelfContained(fn)) {
+				continue;
+			}
+			auto addr = eee->ee->getFunctionAddress(fn.getName().str());
+			if (addr == 0) continue;
+			auto hash = FunctionComparator::functionHash(fn);
+			sharedFunctions[hash].push_back({&fn, addr, eee});
+		}
+	}
+}
+
+// Remove the functions of an engine (or just those of one of its modules)
+// from the cache.
+void unpublishFunctions(EEExternal* eee, Module* mod) {
+	if (!eee->shareFunctions || eee->numPublished == 0) return;
+	std::lock_guard<std::mutex> lock(sharedFunctionsMutex);
+	for (auto& entry : sharedFunctions) {
+		auto& fns = entry.second;
+		fns.erase(std::remove_if(fns.begin(), fns.end(),
+			[eee, mod](const SharedFunction& f) {
+				return f.owner == eee && (!mod || f.fn->getParent() == mod);
+			}), fns.end());
+	}
+}
+
+// Find the definitions in the module whose bodies match an already compiled
+// function of another engine. If there are any, make the engine a private copy
+// of the module in which they are declarations mapped to the compiled code,
+// so that they are not compiled again. The given module is left untouched.
+// Returns the module the engine should compile.
+static Module* reuseFunctions(EEExternal* eee, Module& mod) {
+	if (!eee->shareFunctions) return &mod;
+	std::lock_guard<std::mutex> lock(sharedFunctionsMutex);
+	SmallVector<std::pair<const Function*, const SharedFunction*>, 4> matches;
+	for (auto& fn : mod) {
+		if (fn.isDeclaration() || !isSelfContained(fn)) continue;
+		auto it = sharedFunctions.find(FunctionComparator::functionHash(fn));
+		if (it == sharedFunctions.end()) continue;
+		for (auto& shared : it->second) {
+			if (shared.owner == eee) continue;
+			GlobalNumberState numbers;
+			if (FunctionComparator(shared.fn, &fn, &numbers).compare() != 0) continue;
+			matches.push_back({&fn, &shared});
+			break;
+		}
+	}
+	if (matches.empty()) return &mod;
+	ValueToValueMapTy vmap;
+	auto copy = CloneModule(mod, vmap).release();
+	for (auto& fn : mod) {
+		eee->privateFunctions[&fn] = cast<Function>(vmap[&fn]);
+	}
+	for (auto& match : matches) {
+		auto fn = eee->privateFunctions[match.first];
+		auto& shared = *match.second;
+		fn->deleteBody();
+		fn->setLinkage(GlobalValue::ExternalLinkage);
+		eee->ee->addGlobalMapping(fn, reinterpret_cast<void*>(shared.addr));
+		if (!is_contained(eee->providers, shared.owner)) {
+			shared.owner->refs.fetch_add(1, std::memory_order_relaxed);
+			eee->providers.push_back(shared.owner);
+		}
+		eee->numReused++;
+	}
+	eee->privateModules[&mod] = copy;
+	return copy;
+}
+
+// Get the number of function definitions the given engine
+// replaced with code compiled by other engines.
+extern "C" lean_obj_res papyrus_execution_engine_get_num_reused_functions
+	(b_lean_obj_res eeRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(lean_box_uint64(toEEExternal(eeRef)->numReused));
+}
+
+//------------------------------------------------------------------------------
+// Engine creation and execution
+//------------------------------------------------------------------------------
+
+// Generate code for (and relocate) any modules the engine has yet to compile,
+// so that code generation is timed separately from execution.
+void finalizeEngine(EEExternal* eee) {
+  PhaseScope phase(Phase::Codegen);
+  eee->ee->finalizeObject();
+  publishFunctions(eee);
+}
+
 // Unpack the Lean representation of an engine kind into the LLVM one.
 EngineKind::Kind unpackEngineKnd(uint8_t kind) {
   return kind == 0 ? EngineKind::Either : static_cast<EngineKind::Kind>(kind);
@@ -67,11 +350,54 @@ EngineKind::Kind unpackEngineKnd(uint8_t kind) {
 
 //extern "C" lean_object* mk_io_user_error(lean_object* str);
 
+// Add a module to an engine (which does not take ownership of it).
+// Its code is generated when the engine is next finalized.
+static void addModule(EEExternal* eee, Module* mod) {
+  auto engineMod = reuseFunctions(eee, *mod);
+  eee->ee->addModule(std::unique_ptr<Module>(engineMod));
+  eee->modules.push_back(mod);
+}
+
+// Remove a module from an engine, returning whether it was in the engine.
+// MCJIT cannot unload code, so code already generated for the module
+// stays in memory until the engine is deleted.
+static bool removeModule(EEExternal* eee, Module* mod) {
+  auto it = find(eee->modules, mod);
+  if (it == eee->modules.end()) return false;
+  auto engineMod = eee->getEngineModule(mod);
+  unpublishFunctions(eee, engineMod);
+  if (static_cast<size_t>(it - eee->modules.begin()) < eee->numPublished) {
+    eee->numPublished--;
+  }
+  eee->modules.erase(it);
+  if (engineMod != mod) {
+    // Drop the mappings of the functions the module reused (the definitions
+    // that are declarations in its copy), which would shadow new definitions.
+    // Mappings are keyed by symbol, so the declarations of other modules
+    // must be left alone.
+    for (auto& fn : *mod) {
+      auto copy = eee->privateFunctions.lookup(&fn);
+      if (copy && !fn.isDeclaration() && copy->isDeclaration()) {
+        eee->ee->updateGlobalMapping(copy, nullptr);
+      }
+      eee->privateFunctions.erase(&fn);
+    }
+    eee->privateModules.erase(mod);
+    eee->ee->removeModule(engineMod);
+    delete engineMod;
+  } else {
+    eee->ee->removeModule(mod);
+  }
+  return true;
+}
+
 // Create a new execution engine for the given module.
 extern "C" lean_obj_res papyrus_execution_engine_create_for_module
 (b_lean_obj_res modObj, uint8_t kindObj, b_lean_obj_res marchStr, b_lean_obj_res mcpuStr,
-  b_lean_obj_res mattrsObj, uint8_t optLevel, uint8_t verifyModules, lean_obj_arg /* w */)
+  b_lean_obj_res mattrsObj, uint8_t optLevel, uint8_t verifyModules,
+  uint8_t shareFunctions, lean_obj_arg /* w */)
 {
+  PhaseScope phase(Phase::CreateEngine, toModule(modObj)->getModuleIdentifier());
   // Create an engine builder
 	EngineBuilder builder(std::unique_ptr<Module>(toModule(modObj)));
   // Configure the builder
@@ -81,14 +407,23 @@ extern "C" lean_obj_res papyrus_execution_engine_create_for_module
   builder.setErrorStr(errMsg);
   builder.setOptLevel(static_cast<CodeGenOpt::Level>(optLevel));
   builder.setVerifyModules(verifyModules);
+  builder.setMCJITMemoryManager(std::make_unique<CountingMemoryManager>());
   builder.setMArch(refOfString(marchStr));
   builder.setMCPU(refOfString(mcpuStr));
-  LEAN_ARRAY_TO_REF(std::string, stdOfString, mattrsObj, mattrs);
-  builder.setMAttrs(mattrs);
+  // The builder copies the attributes, so they can just be viewed.
+  builder.setMAttrs(unpackArray<StringRef>(mattrsObj, refOfString));
   // Try to construct the execution engine
   if (ExecutionEngine* ee = builder.create()) {
     auto eee = new EEExternal(ee, errMsg);
     eee->modules.push_back(toModule(modObj));
+    // Only JIT engines (which have a target machine) run native code
+    eee->shareFunctions = shareFunctions && ee->getTargetMachine();
+    // Compile a private copy of the module if it reuses functions
+    auto engineMod = reuseFunctions(eee, *toModule(modObj));
+    if (engineMod != toModule(modObj)) {
+      ee->removeModule(toModule(modObj));
+      ee->addModule(std::unique_ptr<Module>(engineMod));
+    }
     return lean_io_result_mk_ok(mkExecutionEngineRef(eee));
   } else {
     // Steal back the module pointer before it gets deleted
@@ -100,13 +435,77 @@ extern "C" lean_obj_res papyrus_execution_engine_create_for_module
   return lean_io_result_mk_ok(lean_box(0));
 }
 
+// Add the given module to the given execution engine.
+extern "C" lean_obj_res papyrus_execution_engine_add_module
+(b_lean_obj_res eeRef, b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+  auto eee = toEEExternal(eeRef);
+  auto mod = toModule(modRef);
+  if (is_contained(eee->modules, mod)) {
+    return mkStringError("Module is already in the execution engine.");
+  }
+  addModule(eee, mod);
+  return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Remove the given module from the given execution engine.
+extern "C" lean_obj_res papyrus_execution_engine_remove_module
+(b_lean_obj_res eeRef, b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+  if (!removeModule(toEEExternal(eeRef), toModule(modRef))) {
+    return mkStringError("Module is not in the execution engine.");
+  }
+  return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Replace a module of the given execution engine with another
+// and generate code for the new module (and any other pending ones).
+// Modules that were already compiled are not recompiled.
+extern "C" lean_obj_res papyrus_execution_engine_replace_module
+(b_lean_obj_res eeRef, b_lean_obj_res oldModRef, b_lean_obj_res newModRef,
+  lean_obj_arg /* w */)
+{
+  auto eee = toEEExternal(eeRef);
+  auto newMod = toModule(newModRef);
+  if (is_contained(eee->modules, newMod)) {
+    return mkStringError("Module is already in the execution engine.");
+  }
+  if (!removeModule(eee, toModule(oldModRef))) {
+    return mkStringError("Module is not in the execution engine.");
+  }
+  addModule(eee, newMod);
+  finalizeEngine(eee);
+  return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Generate code for (and relocate) the modules added to the given
+// execution engine since it was last finalized.
+extern "C" lean_obj_res papyrus_execution_engine_finalize_object
+(b_lean_obj_res eeRef, lean_obj_arg /* w */)
+{
+  finalizeEngine(toEEExternal(eeRef));
+  return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Get the number of modules in the given execution engine.
+extern "C" lean_obj_res papyrus_execution_engine_get_num_modules
+(b_lean_obj_res eeRef, lean_obj_arg /* w */)
+{
+  return lean_io_result_mk_ok(lean_box(toEEExternal(eeRef)->modules.size()));
+}
+
 // Run the given function with given arguments
 // in the given execution engine and return the result.
 extern "C" lean_obj_res papyrus_execution_engine_run_function
 (b_lean_obj_res funRef, b_lean_obj_res eeRef, b_lean_obj_res argsObj, lean_obj_arg /* w */)
 {
-  LEAN_ARRAY_TO_REF(GenericValue, *toGenericValue, argsObj, args);
-  auto ret = toExecutionEngine(eeRef)->runFunction(toFunction(funRef), args);
+  auto args = unpackArray<GenericValue>(argsObj,
+    [](b_lean_obj_arg arg) { return *toGenericValue(arg); });
+  auto eee = toEEExternal(eeRef);
+  auto fn = eee->getEngineFunction(toFunction(funRef));
+  finalizeEngine(eee);
+  PhaseScope phase(Phase::Execute, fn->getName());
+  auto ret = eee->ee->runFunction(fn, args);
   return lean_io_result_mk_ok(mkGenericValueRef(new GenericValue(ret)));
 }
 
@@ -154,10 +553,9 @@ void* ArgvArray::set
   Instead of using LLVM's `runFunctionAsMain` directly,
   we adapt its code to Lean's data structures.
 */
-extern "C" lean_obj_res papyrus_execution_engine_run_function_as_main
-(b_lean_obj_res funRef,  b_lean_obj_res eeRef, b_lean_obj_res argsObj, b_lean_obj_res envObj,  lean_obj_arg /* w */)
+static lean_obj_res runFunctionAsMain
+(EEExternal* eee, Function* fn, b_lean_obj_res argsObj, b_lean_obj_res envObj)
 {
-  auto fn = toFunction(funRef);
   auto fnTy = fn->getFunctionType();
   auto& ctx = fnTy->getContext();
   auto fnArgc = fnTy->getNumParams();
@@ -177,7 +575,7 @@ extern "C" lean_obj_res papyrus_execution_engine_run_function_as_main
 
   ArgvArray argv, env;
   GenericValue fnArgs[fnArgc];
-  auto ee = toExecutionEngine(eeRef);
+  auto ee = eee->ee;
   if (fnArgc > 0) {
     auto argsArr = lean_to_array(argsObj);
     fnArgs[0].IntVal = APInt(32, argsArr->m_size); // argc
@@ -188,8 +586,464 @@ extern "C" lean_obj_res papyrus_execution_engine_run_function_as_main
       }
     }
   }
-  auto gRc = ee->runFunction(toFunction(funRef), ArrayRef<GenericValue>(fnArgs, fnArgc));
+  finalizeEngine(eee);
+  PhaseScope phase(Phase::Execute, fn->getName());
+  auto gRc = ee->runFunction(fn, ArrayRef<GenericValue>(fnArgs, fnArgc));
   return lean_io_result_mk_ok(lean_box_uint32(gRc.IntVal.getZExtValue()));
 }
 
+// Run a `main`-like function in the given execution engine.
+extern "C" lean_obj_res papyrus_execution_engine_run_function_as_main
+(b_lean_obj_res funRef,  b_lean_obj_res eeRef, b_lean_obj_res argsObj, b_lean_obj_res envObj,  lean_obj_arg /* w */)
+{
+  auto eee = toEEExternal(eeRef);
+  return runFunctionAsMain(eee, eee->getEngineFunction(toFunction(funRef)), argsObj, envObj);
+}
+
+//------------------------------------------------------------------------------
+// JIT session
+//------------------------------------------------------------------------------
+
+// The maximum number of compiled modules a JIT session keeps.
+#define PAPYRUS_JIT_SESSION_CAPACITY 64
+
+// A module compiled by the JIT session.
+struct JitEntry {
+  // The hash of the module's bitcode.
+  uint64_t hash;
+
+  // The bitcode the module was parsed from.
+  SmallVector<char, 0> bitcode;
+
+  // The object code the module was compiled to.
+  std::shared_ptr<const MemoryBuffer> object;
+
+  JitEntry(uint64_t hash, SmallVector<char, 0> bitcode,
+    std::shared_ptr<const MemoryBuffer> object)
+    : hash(hash), bitcode(std::move(bitcode)), object(std::move(object)) {}
+
+  JitEntry(const JitEntry&) = delete;
+};
+
+// A process-wide JIT that outlives the contexts of individual scripts.
+// It keeps the object code of the most recently run modules,
+// so that rerunning one only needs to load its code, not compile it again.
+struct JitSession {
+  std::mutex mutex;
+  // Compiled modules, least recently run first.
+  std::vector<std::unique_ptr<JitEntry>> entries;
+
+  JitSession() {
+    // Initialize the native target once for the whole session.
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+  }
+
+  // Get the object code of the module with the given bitcode (if compiled),
+  // marking it as the most recently run.
+  std::shared_ptr<const MemoryBuffer> lookup
+    (uint64_t hash, const SmallVectorImpl<char>& bitcode)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if ((*it)->hash == hash && (*it)->bitcode == bitcode) {
+        std::rotate(it, it + 1, entries.end());
+        return entries.back()->object;
+      }
+    }
+    return nullptr;
+  }
+
+  // Record the object code of a newly compiled module,
+  // evicting the least recently run module if the session is full.
+  void insert(uint64_t hash, SmallVector<char, 0> bitcode,
+    std::shared_ptr<const MemoryBuffer> object)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : entries) {
+      // Compiled concurrently by another run
+      if (entry->hash == hash && entry->bitcode == bitcode) return;
+    }
+    if (entries.size() >= PAPYRUS_JIT_SESSION_CAPACITY) {
+      entries.erase(entries.begin());
+    }
+    entries.push_back(std::make_unique<JitEntry>(
+      hash, std::move(bitcode), std::move(object)));
+  }
+};
+
+// Get the JIT session, starting it if necessary.
+static JitSession& getJitSession() {
+  static JitSession* session = new JitSession();
+  return *session;
+}
+
+// An MCJIT object cache for a single run of a module in the JIT session.
+// It hands out the object code the session compiled the module to before
+// (if any) and otherwise keeps the object code the run compiles.
+class JitObjectCache : public ObjectCache {
+public:
+  JitObjectCache(std::shared_ptr<const MemoryBuffer> object)
+    : object(std::move(object)) {}
+
+  void notifyObjectCompiled(const Module* /* mod */, MemoryBufferRef obj) override {
+    object = MemoryBuffer::getMemBufferCopy(obj.getBuffer(), obj.getBufferIdentifier());
+  }
+
+  std::unique_ptr<MemoryBuffer> getObject(const Module* /* mod */) override {
+    if (!object) return nullptr;
+    // The cache outlives the engine, so the engine can borrow the code
+    return MemoryBuffer::getMemBuffer(object->getMemBufferRef(), false);
+  }
+
+  std::shared_ptr<const MemoryBuffer> object;
+};
+
+// Run the `main` function of the given module in the JIT session.
+// Modules are identified by their bitcode, so a module identical to
+// one the session already compiled is run without compiling it again.
+// Each run parses the module into a fresh context and loads its code
+// into a fresh engine, so it starts from the module's initial state
+// (e.g., of its global variables) and runs without holding the session.
+extern "C" lean_obj_res papyrus_jit_session_run_main
+(b_lean_obj_res modRef, b_lean_obj_res argsObj, b_lean_obj_res envObj,
+  lean_obj_arg /* w */)
+{
+  auto& session = getJitSession();
+  auto name = toModule(modRef)->getModuleIdentifier();
+  SmallVector<char, 0> bitcode;
+  {
+    PhaseScope phase(Phase::WriteBitcode, name);
+    raw_svector_ostream out(bitcode);
+    WriteBitcodeToFile(*toModule(modRef), out);
+  }
+  auto hash = xxHash64(StringRef(bitcode.data(), bitcode.size()));
+  JitObjectCache cache(session.lookup(hash, bitcode));
+  bool cached = cache.object != nullptr;
+
+  LLVMContext ctx;
+  auto buf = MemoryBufferRef(StringRef(bitcode.data(), bitcode.size()), name);
+  Expected<std::unique_ptr<Module>> modOrErr = [&] {
+    PhaseScope phase(Phase::Parse, name);
+    return parseBitcodeFile(buf, ctx);
+  }();
+  if (!modOrErr) return mkStdStringError(toString(modOrErr.takeError()));
+  auto mod = modOrErr->get();
+  auto fn = mod->getFunction("main");
+  if (!fn || fn->isDeclaration()) {
+    return mkStringError("Module has no main function");
+  }
+  PhaseScope phase(Phase::CreateEngine, name);
+  auto errMsg = new std::string();
+  EngineBuilder builder(std::move(*modOrErr));
+  builder.setErrorStr(errMsg);
+  builder.setMCJITMemoryManager(std::make_unique<CountingMemoryManager>());
+  ExecutionEngine* ee = builder.create();
+  if (!ee) {
+    // The builder deletes the module
+    std::string msg = std::move(*errMsg);
+    delete errMsg;
+    return mkStdStringError(msg);
+  }
+  phase.stop();
+  ee->setObjectCache(&cache);
+  auto eee = new EEExternal(ee, errMsg);
+  eee->modules.push_back(mod);
+  finalizeEngine(eee);
+  if (!cached && cache.object) {
+    session.insert(hash, std::move(bitcode), cache.object);
+  }
+  auto res = runFunctionAsMain(eee, fn, argsObj, envObj);
+  // The engine does not delete the modules it is released with
+  releaseEngine(eee);
+  delete mod;
+  return res;
+}
+
+// Get the number of compiled modules the JIT session holds.
+extern "C" lean_obj_res papyrus_jit_session_get_num_modules(lean_obj_arg /* w */) {
+  auto& session = getJitSession();
+  std::lock_guard<std::mutex> lock(session.mutex);
+  return lean_io_result_mk_ok(lean_box(session.entries.size()));
+}
+
+// Discard the compiled modules of the JIT session.
+extern "C" lean_obj_res papyrus_jit_session_clear(lean_obj_arg /* w */) {
+  auto& session = getJitSession();
+  std::lock_guard<std::mutex> lock(session.mutex);
+  session.entries.clear();
+  return lean_io_result_mk_ok(lean_box(0));
+}
+
+//------------------------------------------------------------------------------
+// Tiered execution
+//------------------------------------------------------------------------------
+
+// Whether MCJIT's `runFunction` can call a function of the given type.
+// It only supports `main`-like functions and functions that take
+// no arguments and return a small integer, a float, or a pointer.
+static bool isJitRunnable(FunctionType* fnTy) {
+  auto retTy = fnTy->getReturnType();
+  auto numParams = fnTy->getNumParams();
+  if ((retTy->isIntegerTy(32) || retTy->isVoidTy()) && numParams > 0 && numParams <= 3) {
+    if (!fnTy->getParamType(0)->isIntegerTy(32)) return false;
+    for (unsigned i = 1; i < numParams; i++) {
+      if (!fnTy->getParamType(i)->isPointerTy()) return false;
+    }
+    return true;
+  }
+  if (numParams != 0) return false;
+  if (auto intTy = dyn_cast<IntegerType>(retTy)) {
+    auto bits = intTy->getBitWidth();
+    return bits == 1 || bits == 8 || bits == 16 || bits == 32 || bits == 64;
+  }
+  return retTy->isVoidTy() || retTy->isFloatTy() ||
+    retTy->isDoubleTy() || retTy->isPointerTy();
+}
+
+// An engine that starts running a module in a quick-to-start tier
+// (the interpreter or an unoptimized JIT) and counts the calls made to
+// each function. Once a function has been called often enough,
+// an optimized copy of the module is compiled in the background.
+// Later calls of its functions run the optimized code.
+// The copy only duplicates code: its global variables are bound to
+// those of the base tier, so both tiers see the same program state.
+struct TieredEngine {
+  // The engine running the module until the optimized tier is ready.
+  EEExternal* base;
+
+  // The number of calls to a function that trigger optimization.
+  uint64_t threshold;
+
+  // The optimization level of the optimized tier.
+  unsigned optLevel;
+
+  // Guards the call counts and the start of the background compilation
+  // (and the error that prevented it, if any).
+  std::mutex mutex;
+  DenseMap<const Function*, uint64_t> callCounts;
+  std::thread compiler;
+
+  // The optimized tier. Only accessed once `optimized` is set
+  // (or, for the error, once the compiler has been joined).
+  std::atomic<bool> optimized{false};
+  std::unique_ptr<LLVMContext> optCtx;
+  Module* optMod = nullptr;
+  EEExternal* optEngine = nullptr;
+  std::string compileError;
+
+  TieredEngine(EEExternal* base, uint64_t threshold, unsigned optLevel)
+    : base(base), threshold(threshold), optLevel(optLevel) {}
+
+  TieredEngine(const TieredEngine&) = delete;
+
+  ~TieredEngine() {
+    if (compiler.joinable()) compiler.join();
+    if (optEngine) releaseEngine(optEngine);
+    delete optMod;
+    releaseEngine(base);
+  }
+};
+
+template<> struct ObjectKindOf<TieredEngine> {
+	static constexpr ObjectKind kind = ObjectKind::ExecutionEngine;
+};
+
+// Parse a copy of the module into a fresh context, optimize it,
+// and compile it with an optimizing JIT (on the compiler thread).
+// The copy's global variables with an address in the base tier
+// (given in module order) become declarations bound to that address.
+static void compileOptimizedTier(TieredEngine* te,
+  const SmallVector<char, 0>& bitcode, const std::vector<void*>& globalAddrs)
+{
+  auto ctx = std::make_unique<LLVMContext>();
+  auto buf = MemoryBufferRef(StringRef(bitcode.data(), bitcode.size()), "");
+  auto modOrErr = parseBitcodeFile(buf, *ctx);
+  if (!modOrErr) {
+    te->compileError = toString(modOrErr.takeError());
+    return;
+  }
+  auto mod = modOrErr->get();
+  SmallVector<std::pair<GlobalVariable*, void*>, 8> sharedGlobals;
+  size_t i = 0;
+  for (auto& gv : mod->globals()) {
+    auto addr = globalAddrs[i++];
+    if (!addr) continue;
+    gv.setInitializer(nullptr);
+    gv.setComdat(nullptr);
+    gv.setLinkage(GlobalValue::ExternalLinkage);
+    gv.setVisibility(GlobalValue::DefaultVisibility);
+    gv.setDSOLocal(false);
+    // Mappings are by symbol, so unnamed globals need a name
+    if (!gv.hasName()) gv.setName("papyrus.tiered.global");
+    sharedGlobals.push_back({&gv, addr});
+  }
+  auto errMsg = new std::string();
+  EngineBuilder builder(std::move(*modOrErr));
+  builder.setEngineKind(EngineKind::JIT);
+  builder.setErrorStr(errMsg);
+  builder.setOptLevel(static_cast<CodeGenOpt::Level>(te->optLevel));
+  builder.setMCJITMemoryManager(std::make_unique<CountingMemoryManager>());
+  ExecutionEngine* ee = builder.create();
+  if (!ee) {
+    // The builder deletes the module
+    te->compileError = std::move(*errMsg);
+    delete errMsg;
+    return;
+  }
+  auto eee = new EEExternal(ee, errMsg);
+  eee->modules.push_back(mod);
+  for (auto& shared : sharedGlobals) {
+    ee->addGlobalMapping(shared.first, shared.second);
+  }
+  {
+    PhaseScope phase(Phase::Codegen, mod->getModuleIdentifier());
+    optimizeModule(*mod, ee->getTargetMachine(), te->optLevel);
+  }
+  finalizeEngine(eee);
+  te->optCtx = std::move(ctx);
+  te->optMod = mod;
+  te->optEngine = eee;
+  te->optimized.store(true, std::memory_order_release);
+}
+
+// Start compiling the optimized tier in the background.
+// The module is snapshot as bitcode first, so it can keep changing
+// (and running in the base tier) while the copy is compiled.
+// The addresses of its global variables in the base tier are looked up
+// beforehand. Returns an error message (and does not start) if a mutable
+// global has no address the optimized tier can share: thread-local ones
+// and, if the base tier is a JIT, local ones (which it does not export).
+static Optional<std::string> startTierUp(TieredEngine* te, Module& mod) {
+  finalizeEngine(te->base);
+  auto ee = te->base->ee;
+  std::vector<void*> globalAddrs;
+  for (auto& gv : mod.globals()) {
+    void* addr = nullptr;
+    if (!gv.isDeclaration() && !gv.isThreadLocal()) {
+      if (!ee->getTargetMachine()) {
+        addr = ee->getPointerToGlobal(&gv);
+      } else if (!gv.hasLocalLinkage()) {
+        addr = reinterpret_cast<void*>(ee->getGlobalValueAddress(gv.getName().str()));
+      }
+    }
+    if (!addr && !gv.isDeclaration() && !gv.isConstant()) {
+      return "Cannot share global variable '" + gv.getName().str() +
+        "' with the optimized tier.";
+    }
+    globalAddrs.push_back(addr);
+  }
+  SmallVector<char, 0> bitcode;
+  {
+    PhaseScope phase(Phase::WriteBitcode, mod.getModuleIdentifier());
+    raw_svector_ostream out(bitcode);
+    WriteBitcodeToFile(mod, out);
+  }
+  te->compiler = std::thread(
+    [te, bitcode = std::move(bitcode), globalAddrs = std::move(globalAddrs)] {
+      compileOptimizedTier(te, bitcode, globalAddrs);
+    });
+  return None;
+}
+
+// Create a new tiered execution engine for the given module.
+// The base tier is an interpreter if `interpret` is set
+// and an unoptimized JIT otherwise.
+extern "C" lean_obj_res papyrus_tiered_engine_create
+(b_lean_obj_res modObj, uint8_t interpret, uint32_t threshold, uint8_t optLevel,
+  lean_obj_arg /* w */)
+{
+  auto mod = toModule(modObj);
+  PhaseScope phase(Phase::CreateEngine, mod->getModuleIdentifier());
+  EngineBuilder builder{std::unique_ptr<Module>(mod)};
+  // Like MCJIT, give a module without a data layout the host's,
+  // so that both tiers lay out the global variables they share alike
+  if (interpret && mod->getDataLayout().isDefault()) {
+    if (std::unique_ptr<TargetMachine> tm{builder.selectTarget()}) {
+      mod->setDataLayout(tm->createDataLayout());
+    }
+  }
+  auto errMsg = new std::string();
+  builder.setEngineKind(interpret ? EngineKind::Interpreter : EngineKind::JIT);
+  builder.setErrorStr(errMsg);
+  builder.setOptLevel(CodeGenOpt::None);
+  builder.setMCJITMemoryManager(std::make_unique<CountingMemoryManager>());
+  if (ExecutionEngine* ee = builder.create()) {
+    auto eee = new EEExternal(ee, errMsg);
+    eee->modules.push_back(mod);
+    auto te = new TieredEngine(eee, threshold, optLevel);
+    return lean_io_result_mk_ok(mkOwnedPtr<TieredEngine>(te));
+  } else {
+    // Steal back the module pointer before it gets deleted
+    reinterpret_cast<std::unique_ptr<Module>&>(builder).release();
+    auto res = mkStdStringError(*errMsg);
+    delete errMsg;
+    return res;
+  }
+}
+
+// Run the given function with the given arguments in the given tiered engine.
+// Runs the optimized code if it is ready (and MCJIT can call the function),
+// and otherwise counts the call and runs the function in the base tier.
+extern "C" lean_obj_res papyrus_tiered_engine_run_function
+(b_lean_obj_res funRef, b_lean_obj_res teRef, b_lean_obj_res argsObj, lean_obj_arg /* w */)
+{
+  auto args = unpackArray<GenericValue>(argsObj,
+    [](b_lean_obj_arg arg) { return *toGenericValue(arg); });
+  auto fn = toFunction(funRef);
+  auto te = fromOwnedPtr<TieredEngine>(teRef);
+  if (te->optimized.load(std::memory_order_acquire)) {
+    auto optFn = fn->hasName() ? te->optMod->getFunction(fn->getName()) : nullptr;
+    if (optFn && !optFn->isDeclaration() && isJitRunnable(optFn->getFunctionType())) {
+      PhaseScope phase(Phase::Execute, fn->getName());
+      auto ret = te->optEngine->ee->runFunction(optFn, args);
+      return lean_io_result_mk_ok(mkGenericValueRef(new GenericValue(ret)));
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(te->mutex);
+    if (++te->callCounts[fn] >= te->threshold &&
+      !te->compiler.joinable() && te->compileError.empty())
+    {
+      if (auto err = startTierUp(te, *fn->getParent())) {
+        te->compileError = std::move(*err);
+      }
+    }
+  }
+  finalizeEngine(te->base);
+  PhaseScope phase(Phase::Execute, fn->getName());
+  auto ret = te->base->ee->runFunction(fn, args);
+  return lean_io_result_mk_ok(mkGenericValueRef(new GenericValue(ret)));
+}
+
+// Get the number of calls of the given function run in the base tier.
+extern "C" lean_obj_res papyrus_tiered_engine_get_call_count
+(b_lean_obj_res funRef, b_lean_obj_res teRef, lean_obj_arg /* w */)
+{
+  auto te = fromOwnedPtr<TieredEngine>(teRef);
+  std::lock_guard<std::mutex> lock(te->mutex);
+  return lean_io_result_mk_ok(lean_box_uint64(te->callCounts.lookup(toFunction(funRef))));
+}
+
+// Get whether the optimized tier of the given engine is ready.
+extern "C" lean_obj_res papyrus_tiered_engine_is_optimized
+(b_lean_obj_res teRef, lean_obj_arg /* w */)
+{
+  auto te = fromOwnedPtr<TieredEngine>(teRef);
+  return lean_io_result_mk_ok(lean_box(te->optimized.load(std::memory_order_acquire)));
+}
+
+// Wait for the background compilation of the optimized tier (if started)
+// to finish, reporting any error it encountered.
+extern "C" lean_obj_res papyrus_tiered_engine_wait
+(b_lean_obj_res teRef, lean_obj_arg /* w */)
+{
+  auto te = fromOwnedPtr<TieredEngine>(teRef);
+  std::lock_guard<std::mutex> lock(te->mutex);
+  if (te->compiler.joinable()) te->compiler.join();
+  if (!te->compileError.empty()) {
+    return mkStdStringError(te->compileError);
+  }
+  return lean_io_result_mk_ok(lean_box(0));
+}
+
 } // end namespace papyrus
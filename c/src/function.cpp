@@ -59,6 +59,7 @@ extern "C" lean_obj_res papyrus_function_append_basic_block
 extern "C" lean_obj_res papyrus_function_verify
 	(b_lean_obj_res funRef, lean_obj_arg /* w */)
 {
+	PhaseScope phase(Phase::Verify, toFunction(funRef)->getName());
 	std::string ostr;
 	raw_string_ostream out(ostr);
 	if (llvm::verifyFunction(*toFunction(funRef), &out)) {
@@ -13,6 +13,64 @@ llvm::Instruction* toInstruction(lean_object* instRef) {
 	return llvm::cast<Instruction>(toValue(instRef));
 }
 
+//------------------------------------------------------------------------------
+// Placement
+//------------------------------------------------------------------------------
+
+// Get the basic block containing the given instruction (if any).
+extern "C" lean_obj_res papyrus_instruction_get_parent
+	(b_lean_obj_res instRef, lean_obj_arg /* w */)
+{
+	auto bb = toInstruction(instRef)->getParent();
+	auto obj = bb ? mkSome(mkValueRef(copyLink(instRef), bb)) : lean_box(0);
+	return lean_io_result_mk_ok(obj);
+}
+
+// Move the given instruction (which may be unlinked) right before another.
+extern "C" lean_obj_res papyrus_instruction_move_before
+	(b_lean_obj_res instRef, b_lean_obj_res posRef, lean_obj_arg /* w */)
+{
+	auto inst = toInstruction(instRef);
+	auto pos = toInstruction(posRef);
+	if (inst == pos) return mkStringError("Cannot move an instruction relative to itself.");
+	if (!pos->getParent()) return mkStringError("Position is not in a basic block.");
+	if (inst->getParent()) inst->moveBefore(pos); else inst->insertBefore(pos);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Move the given instruction (which may be unlinked) right after another.
+extern "C" lean_obj_res papyrus_instruction_move_after
+	(b_lean_obj_res instRef, b_lean_obj_res posRef, lean_obj_arg /* w */)
+{
+	auto inst = toInstruction(instRef);
+	auto pos = toInstruction(posRef);
+	if (inst == pos) return mkStringError("Cannot move an instruction relative to itself.");
+	if (!pos->getParent()) return mkStringError("Position is not in a basic block.");
+	if (inst->getParent()) inst->moveAfter(pos); else inst->insertAfter(pos);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Unlink the given instruction from its basic block without deleting it.
+extern "C" lean_obj_res papyrus_instruction_remove_from_parent
+	(b_lean_obj_res instRef, lean_obj_arg /* w */)
+{
+	auto inst = toInstruction(instRef);
+	if (!inst->getParent()) return mkStringError("Instruction is not in a basic block.");
+	inst->removeFromParent();
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Unlink the given (unused) instruction from its basic block and delete it.
+extern "C" lean_obj_res papyrus_instruction_erase_from_parent
+	(b_lean_obj_res instRef, lean_obj_arg /* w */)
+{
+	auto inst = toInstruction(instRef);
+	if (!inst->getParent()) return mkStringError("Instruction is not in a basic block.");
+	if (!inst->use_empty()) return mkStringError("Instruction still has uses.");
+	inst->eraseFromParent();
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
 //------------------------------------------------------------------------------
 // Return
 //------------------------------------------------------------------------------
@@ -150,6 +208,42 @@ extern "C" lean_obj_res papyrus_branch_inst_swap_successors
 	return lean_io_result_mk_ok(lean_box(0));
 }
 
+//------------------------------------------------------------------------------
+// Binary Operators
+//------------------------------------------------------------------------------
+
+// Check whether the given binary operator is defined for operands of the given type.
+bool isValidBinaryOp(unsigned opcode, Type* type) {
+	if (!Instruction::isBinaryOp(opcode)) return false;
+	switch (opcode) {
+	case Instruction::FAdd:
+	case Instruction::FSub:
+	case Instruction::FMul:
+	case Instruction::FDiv:
+	case Instruction::FRem:
+		return type->isFPOrFPVectorTy();
+	default:
+		return type->isIntOrIntVectorTy();
+	}
+}
+
+// Get a reference to a newly created binary operator.
+extern "C" lean_obj_res papyrus_binary_operator_create
+	(uint8_t kind, b_lean_obj_res lhsRef, b_lean_obj_res rhsRef,
+		b_lean_obj_res nameObj, lean_obj_arg /* w */)
+{
+	unsigned opcode = kind + 1;
+	auto lhs = toValue(lhsRef);
+	auto rhs = toValue(rhsRef);
+	if (lhs->getType() != rhs->getType())
+		return mkStringError("Operands of a binary operator must have the same type.");
+	if (!isValidBinaryOp(opcode, lhs->getType()))
+		return mkStringError("Not a binary operator on operands of this type.");
+	auto i = BinaryOperator::Create(static_cast<Instruction::BinaryOps>(opcode),
+		lhs, rhs, refOfString(nameObj));
+	return lean_io_result_mk_ok(mkValueRef(copyLink(lhsRef), i));
+}
+
 //------------------------------------------------------------------------------
 // Load
 //------------------------------------------------------------------------------
@@ -364,7 +458,7 @@ extern "C" lean_obj_res papyrus_getelementptr_inst_create
 	(b_lean_obj_res typeRef, b_lean_obj_res ptrValRef, b_lean_obj_res indicesObj,
 		b_lean_obj_res nameObj, lean_obj_arg /* w */)
 {
-	LEAN_ARRAY_TO_REF(Value*, toValue, indicesObj, indices);
+	auto indices = unpackArray<Value*>(indicesObj, toValue);
 	auto inst = GetElementPtrInst::Create(
 		toType(typeRef), toValue(ptrValRef), indices, refOfString(nameObj));
 	return lean_io_result_mk_ok(mkValueRef(copyLink(typeRef), inst));
@@ -375,7 +469,7 @@ extern "C" lean_obj_res papyrus_getelementptr_inst_create_inbounds
 	(b_lean_obj_res typeRef, b_lean_obj_res ptrVal, b_lean_obj_res indicesObj,
 		b_lean_obj_res nameObj, lean_obj_arg /* w */)
 {
-	LEAN_ARRAY_TO_REF(Value*, toValue, indicesObj, indices);
+	auto indices = unpackArray<Value*>(indicesObj, toValue);
 	auto inst = GetElementPtrInst::CreateInBounds(
 		toType(typeRef), toValue(ptrVal), indices, refOfString(nameObj));
 	return lean_io_result_mk_ok(mkValueRef(copyLink(typeRef), inst));
@@ -427,7 +521,7 @@ extern "C" lean_obj_res papyrus_call_inst_create
 	(b_lean_obj_res typeRef, b_lean_obj_res funVal, b_lean_obj_res argsObj,
 		b_lean_obj_res nameObj, lean_obj_arg /* w */)
 {
-	LEAN_ARRAY_TO_REF(Value*, toValue, argsObj, args);
+	auto args = unpackArray<Value*>(argsObj, toValue);
 	auto i = CallInst::Create(toFunctionType(typeRef), toValue(funVal), args,
 		refOfString(nameObj));
 	return lean_io_result_mk_ok(mkValueRef(copyLink(typeRef), i));
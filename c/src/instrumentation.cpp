@@ -0,0 +1,246 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+
+#include <atomic>
+#include <mutex>
+#include <lean/lean.h>
+#include <llvm/Pass.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/Support/Timer.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+namespace papyrus {
+
+//------------------------------------------------------------------------------
+// Phase timing
+//------------------------------------------------------------------------------
+
+// The accumulated time spent in a phase.
+struct PhaseTotal {
+	uint64_t count = 0;
+	double wall = 0;
+	double user = 0;
+	double system = 0;
+};
+
+static std::atomic<bool> phaseTimingEnabled(false);
+static std::mutex phaseTotalsMutex;
+static PhaseTotal phaseTotals[PAPYRUS_NUM_PHASES];
+
+// The number of times Papyrus has started or stopped the time trace profiler
+// on this thread. A restarted profiler may reuse the address of the old one,
+// so scopes tell profilers apart by both.
+static thread_local uint64_t traceGeneration = 0;
+
+// Get the time trace profiler of the current thread (if any).
+static TimeTraceProfiler* getTraceProfiler() {
+#if LLVM_VERSION_MAJOR >= 13
+	return getTimeTraceProfilerInstance();
+#else
+	return TimeTraceProfilerInstance;
+#endif
+}
+
+// The name of a phase as it appears in the time trace.
+static const char* phaseTraceName(Phase phase) {
+	switch (phase) {
+		case Phase::Construct: return "PapyrusConstruct";
+		case Phase::Parse: return "PapyrusParse";
+		case Phase::Verify: return "PapyrusVerify";
+		case Phase::Print: return "PapyrusPrint";
+		case Phase::WriteBitcode: return "PapyrusWriteBitcode";
+		case Phase::CreateEngine: return "PapyrusCreateEngine";
+		case Phase::Codegen: return "PapyrusCodegen";
+		case Phase::Execute: return "PapyrusExecute";
+	}
+	return "Papyrus";
+}
+
+PhaseScope::PhaseScope(Phase phase) : PhaseScope(phase, StringRef()) {}
+
+PhaseScope::PhaseScope(Phase phase, const StringRef& detail)
+	: phase(phase), timing(phaseTimingEnabled.load(std::memory_order_relaxed)),
+		profiler(getTraceProfiler()), profilerGeneration(traceGeneration)
+{
+	if (profiler) {
+		timeTraceProfilerBegin(phaseTraceName(phase), detail);
+	}
+	if (timing) {
+		auto start = TimeRecord::getCurrentTime(true);
+		wallStart = start.getWallTime();
+		userStart = start.getUserTime();
+		systemStart = start.getSystemTime();
+	}
+}
+
+PhaseScope::~PhaseScope() {
+	stop();
+}
+
+void PhaseScope::stop() {
+	if (timing) {
+		auto end = TimeRecord::getCurrentTime(false);
+		std::lock_guard<std::mutex> lock(phaseTotalsMutex);
+		auto& total = phaseTotals[static_cast<uint8_t>(phase)];
+		total.count++;
+		total.wall += end.getWallTime() - wallStart;
+		total.user += end.getUserTime() - userStart;
+		total.system += end.getSystemTime() - systemStart;
+		timing = false;
+	}
+	if (profiler) {
+		// Only end the event on the profiler (and thread) it began on.
+		// The profiler may have been torn down or restarted in the meantime.
+		if (getTraceProfiler() == profiler && traceGeneration == profilerGeneration) {
+			timeTraceProfilerEnd();
+		}
+		profiler = nullptr;
+	}
+}
+
+// Enable Papyrus' phase timing along with, optionally,
+// LLVM's pass timing and statistics collection.
+extern "C" lean_obj_res papyrus_instrumentation_enable
+	(uint8_t timePasses, uint8_t collectStatistics, lean_obj_arg /* w */)
+{
+	phaseTimingEnabled = true;
+	TimePassesIsEnabled = timePasses;
+	if (collectStatistics) EnableStatistics(false);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Disable Papyrus' phase timing and LLVM's pass timing.
+// LLVM statistics, once enabled, cannot be disabled.
+extern "C" lean_obj_res papyrus_instrumentation_disable(lean_obj_arg /* w */) {
+	phaseTimingEnabled = false;
+	TimePassesIsEnabled = false;
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Reset the accumulated phase times, pass timings, and statistics.
+extern "C" lean_obj_res papyrus_instrumentation_reset(lean_obj_arg /* w */) {
+	{
+		std::lock_guard<std::mutex> lock(phaseTotalsMutex);
+		for (auto& total : phaseTotals) total = PhaseTotal();
+	}
+	std::string ostr;
+	raw_string_ostream out(ostr);
+	reportAndResetTimings(&out);
+	ResetStatistics();
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Get an array of the accumulated time spent in each phase (indexed by phase).
+extern "C" lean_obj_res papyrus_instrumentation_get_phase_timings
+	(lean_obj_arg /* w */)
+{
+	lean_object* arr = lean_alloc_array(PAPYRUS_NUM_PHASES, PAPYRUS_NUM_PHASES);
+	lean_array_object* arrObj = lean_to_array(arr);
+	std::lock_guard<std::mutex> lock(phaseTotalsMutex);
+	for (size_t i = 0; i < PAPYRUS_NUM_PHASES; i++) {
+		auto& total = phaseTotals[i];
+		lean_object* obj = lean_alloc_ctor(0, 0, 4*sizeof(uint64_t));
+		lean_ctor_set_uint64(obj, 0, total.count);
+		lean_ctor_set_float(obj, 1*sizeof(uint64_t), total.wall);
+		lean_ctor_set_float(obj, 2*sizeof(uint64_t), total.user);
+		lean_ctor_set_float(obj, 3*sizeof(uint64_t), total.system);
+		arrObj->m_data[i] = obj;
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+// Get an array of the LLVM statistics collected so far.
+// Statistics are only collected by LLVM builds with them enabled
+// (e.g., those with assertions), so the array may be empty.
+extern "C" lean_obj_res papyrus_instrumentation_get_statistics
+	(lean_obj_arg /* w */)
+{
+	auto stats = GetStatistics();
+	lean_object* arr = lean_alloc_array(0, stats.size());
+	for (auto& stat : stats) {
+		lean_object* obj = lean_alloc_ctor(0, 1, sizeof(uint64_t));
+		lean_ctor_set(obj, 0, mkStringFromRef(stat.first));
+		lean_ctor_set_uint64(obj, sizeof(void*), stat.second);
+		arr = lean_array_push(arr, obj);
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+// Get LLVM's pass timing report (as printed by `-time-passes`)
+// and reset the pass timers.
+extern "C" lean_obj_res papyrus_instrumentation_take_pass_timings
+	(lean_obj_arg /* w */)
+{
+	std::string ostr;
+	raw_string_ostream out(ostr);
+	reportAndResetTimings(&out);
+	return lean_io_result_mk_ok(mkStringFromStd(out.str()));
+}
+
+//------------------------------------------------------------------------------
+// Time trace profiling
+//------------------------------------------------------------------------------
+
+// Start LLVM's time trace profiler on the current thread.
+// Events shorter than `granularity` microseconds are dropped.
+extern "C" lean_obj_res papyrus_time_trace_start
+	(uint32_t granularity, b_lean_obj_res procNameObj, lean_obj_arg /* w */)
+{
+	if (!timeTraceProfilerEnabled()) {
+		timeTraceProfilerInitialize(granularity, refOfString(procNameObj));
+		traceGeneration++;
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Write the events recorded by the time trace profiler
+// to the given file in the Chrome trace event JSON format.
+extern "C" lean_obj_res papyrus_time_trace_write
+	(b_lean_obj_res fnameObj, lean_obj_arg /* w */)
+{
+	if (!timeTraceProfilerEnabled()) {
+		return mkStringError("Time trace profiler is not running.");
+	}
+	auto fname = refOfString(fnameObj);
+	if (auto err = timeTraceProfilerWrite(fname, fname)) {
+		return mkStdStringError(toString(std::move(err)));
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Stop the time trace profiler, discarding any unwritten events.
+extern "C" lean_obj_res papyrus_time_trace_stop(lean_obj_arg /* w */) {
+	if (timeTraceProfilerEnabled()) {
+		timeTraceProfilerCleanup();
+		traceGeneration++;
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+//------------------------------------------------------------------------------
+// User phases
+//------------------------------------------------------------------------------
+
+// Begin timing a phase of user code (e.g., IR construction).
+// The phase ends when the returned object is stopped or garbage collected.
+extern "C" lean_obj_res papyrus_phase_scope_start
+	(uint8_t phase, b_lean_obj_res detailObj, lean_obj_arg /* w */)
+{
+	auto scope = new PhaseScope(static_cast<Phase>(phase), refOfString(detailObj));
+	return lean_io_result_mk_ok(mkOwnedPtr<PhaseScope>(scope));
+}
+
+// End the phase of the given scope.
+extern "C" lean_obj_res papyrus_phase_scope_stop
+	(b_lean_obj_res scopeObj, lean_obj_arg /* w */)
+{
+	fromOwnedPtr<PhaseScope>(scopeObj)->stop();
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+} // end namespace papyrus
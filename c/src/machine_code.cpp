@@ -0,0 +1,364 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+#include "papyrus_machine_code.h"
+
+#include <vector>
+#include <lean/lean.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/MC/MCAsmInfo.h>
+#include <llvm/MC/MCContext.h>
+#include <llvm/MC/MCDisassembler/MCDisassembler.h>
+#include <llvm/MC/MCInst.h>
+#include <llvm/MC/MCInstPrinter.h>
+#include <llvm/MC/MCInstrAnalysis.h>
+#include <llvm/MC/MCInstrInfo.h>
+#include <llvm/MC/MCRegisterInfo.h>
+#include <llvm/MC/MCSchedule.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MCA/Context.h>
+#include <llvm/MCA/HWEventListener.h>
+#include <llvm/MCA/InstrBuilder.h>
+#include <llvm/MCA/Pipeline.h>
+#include <llvm/MCA/SourceMgr.h>
+#include <llvm/MCA/Support.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#if LLVM_VERSION_MAJOR >= 13
+#include <llvm/MCA/CustomBehaviour.h>
+#endif
+#if LLVM_VERSION_MAJOR >= 14
+#include <llvm/MC/TargetRegistry.h>
+#else
+#include <llvm/Support/TargetRegistry.h>
+#endif
+
+using namespace llvm;
+
+namespace papyrus {
+
+//------------------------------------------------------------------------------
+// Code recording
+//------------------------------------------------------------------------------
+
+void CodeRecorder::notifyObjectLoaded(ObjectKey key,
+	const object::ObjectFile& obj, const RuntimeDyld::LoadedObjectInfo& info)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto& names = symbols[key];
+	for (auto& symSize : object::computeSymbolSizes(obj)) {
+		auto& sym = symSize.first;
+		auto type = expectedToOptional(sym.getType());
+		if (!type || *type != object::SymbolRef::ST_Function) continue;
+		auto name = expectedToOptional(sym.getName());
+		auto addr = expectedToOptional(sym.getAddress());
+		auto sec = expectedToOptional(sym.getSection());
+		if (!name || !addr || !sec || *sec == obj.section_end()) continue;
+		// Symbol addresses are relative to the object, not where it was loaded
+		auto loadAddr = info.getSectionLoadAddress(**sec) + (*addr - (*sec)->getAddress());
+		ranges[*name] = {loadAddr, symSize.second};
+		names.push_back(name->str());
+	}
+}
+
+void CodeRecorder::notifyFreeingObject(ObjectKey key) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = symbols.find(key);
+	if (it == symbols.end()) return;
+	for (auto& name : it->second) ranges.erase(name);
+	symbols.erase(it);
+}
+
+Optional<CodeRange> CodeRecorder::lookup(StringRef symbol) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = ranges.find(symbol);
+	if (it == ranges.end()) return None;
+	return it->second;
+}
+
+//------------------------------------------------------------------------------
+// Decoding
+//------------------------------------------------------------------------------
+
+// An instruction decoded from machine code.
+struct DecodedInst {
+	MCInst inst;
+	uint64_t addr;
+	uint64_t size;
+	// Whether the bytes decoded to a valid instruction.
+	bool valid;
+};
+
+// The MC layer of a target machine needed to decode its machine code.
+struct Decoder {
+	TargetMachine& tm;
+	std::unique_ptr<MCContext> ctx;
+	std::unique_ptr<MCDisassembler> disasm;
+
+	Decoder(TargetMachine& tm) : tm(tm) {}
+	Decoder(const Decoder&) = delete;
+};
+
+// Create a decoder for the machine code of the given target machine.
+// Fails if the target's disassembler has not been initialized.
+static Expected<std::unique_ptr<Decoder>> createDecoder(TargetMachine& tm) {
+	auto decoder = std::make_unique<Decoder>(tm);
+#if LLVM_VERSION_MAJOR >= 13
+	decoder->ctx = std::make_unique<MCContext>(tm.getTargetTriple(),
+		tm.getMCAsmInfo(), tm.getMCRegisterInfo(), tm.getMCSubtargetInfo());
+#else
+	decoder->ctx = std::make_unique<MCContext>(
+		tm.getMCAsmInfo(), tm.getMCRegisterInfo(), nullptr);
+#endif
+	decoder->disasm.reset(tm.getTarget().createMCDisassembler(
+		*tm.getMCSubtargetInfo(), *decoder->ctx));
+	if (!decoder->disasm) {
+		return createStringError(inconvertibleErrorCode(),
+			"Target has no disassembler (see `initNativeDisassembler`).");
+	}
+	return decoder;
+}
+
+// Decode the machine code in the given (loaded) range of memory.
+// Undecodable bytes are skipped as invalid instructions.
+static std::vector<DecodedInst> decode(Decoder& decoder, CodeRange range) {
+	ArrayRef<uint8_t> bytes(reinterpret_cast<const uint8_t*>(range.addr), range.size);
+	std::vector<DecodedInst> insts;
+	uint64_t offset = 0;
+	while (offset < bytes.size()) {
+		DecodedInst decoded;
+		decoded.addr = range.addr + offset;
+		decoded.valid = decoder.disasm->getInstruction(decoded.inst, decoded.size,
+			bytes.slice(offset), decoded.addr, nulls()) == MCDisassembler::Success;
+		if (decoded.size == 0) decoded.size = 1;
+		offset += decoded.size;
+		insts.push_back(std::move(decoded));
+	}
+	return insts;
+}
+
+//------------------------------------------------------------------------------
+// Disassembly
+//------------------------------------------------------------------------------
+
+// Get the size (in bytes) of the machine code the given execution engine
+// compiled for the given function (compiling it if necessary).
+extern "C" lean_obj_res papyrus_execution_engine_get_code_size
+	(b_lean_obj_res funRef, b_lean_obj_res eeRef, lean_obj_arg /* w */)
+{
+	auto rangeOrErr = getFunctionCode(eeRef, toFunction(funRef));
+	if (!rangeOrErr) return mkStdStringError(toString(rangeOrErr.takeError()));
+	return lean_io_result_mk_ok(lean_uint64_to_nat(rangeOrErr->size));
+}
+
+// Print an instruction in the target's assembly syntax
+// (with the mnemonic and its operands separated by a single space).
+static std::string printInst(MCInstPrinter& printer, const DecodedInst& decoded,
+	const MCSubtargetInfo& sti)
+{
+	if (!decoded.valid) return "<unknown>";
+	std::string text;
+	raw_string_ostream out(text);
+	printer.printInst(&decoded.inst, decoded.addr, "", sti, out);
+	out.flush();
+	auto trimmed = StringRef(text).trim();
+	auto parts = trimmed.split('\t');
+	if (parts.second.empty()) return parts.first.str();
+	return (parts.first + " " + parts.second.ltrim()).str();
+}
+
+// Disassemble the machine code the given execution engine compiled
+// for the given function (compiling it if necessary).
+// Returns a `FunctionCode` of the code's address, size, and instructions.
+extern "C" lean_obj_res papyrus_execution_engine_disassemble
+	(b_lean_obj_res funRef, b_lean_obj_res eeRef, lean_obj_arg /* w */)
+{
+	auto rangeOrErr = getFunctionCode(eeRef, toFunction(funRef));
+	if (!rangeOrErr) return mkStdStringError(toString(rangeOrErr.takeError()));
+	auto& tm = *toExecutionEngine(eeRef)->getTargetMachine();
+	auto decoderOrErr = createDecoder(tm);
+	if (!decoderOrErr) return mkStdStringError(toString(decoderOrErr.takeError()));
+	auto mai = tm.getMCAsmInfo();
+	std::unique_ptr<MCInstPrinter> printer(tm.getTarget().createMCInstPrinter(
+		tm.getTargetTriple(), mai->getAssemblerDialect(), *mai,
+		*tm.getMCInstrInfo(), *tm.getMCRegisterInfo()));
+	if (!printer) {
+		return mkStringError("Target has no instruction printer (see `initNativeAsmPrinter`).");
+	}
+	auto& sti = *tm.getMCSubtargetInfo();
+	auto decoded = decode(**decoderOrErr, *rangeOrErr);
+	lean_object* arr = lean_alloc_array(0, decoded.size());
+	for (auto& inst : decoded) {
+		lean_object* obj = lean_alloc_ctor(0, 2, sizeof(uint64_t));
+		lean_ctor_set(obj, 0, lean_box(inst.size));
+		lean_ctor_set(obj, 1, mkStringFromStd(printInst(*printer, inst, sti)));
+		lean_ctor_set_uint64(obj, sizeof(void*)*2, inst.addr);
+		arr = lean_array_push(arr, obj);
+	}
+	lean_object* obj = lean_alloc_ctor(0, 2, sizeof(uint64_t));
+	lean_ctor_set(obj, 0, lean_uint64_to_nat(rangeOrErr->size));
+	lean_ctor_set(obj, 1, arr);
+	lean_ctor_set_uint64(obj, sizeof(void*)*2, rangeOrErr->addr);
+	return lean_io_result_mk_ok(obj);
+}
+
+//------------------------------------------------------------------------------
+// Throughput analysis
+//------------------------------------------------------------------------------
+
+// Collects the resource usage and bottlenecks of an MCA pipeline.
+class ThroughputListener : public mca::HWEventListener {
+public:
+	ThroughputListener(const MCSchedModel& sm)
+		: sm(sm), masks(sm.getNumProcResourceKinds()), cycles(sm.getNumProcResourceKinds())
+	{
+		mca::computeProcResourceMasks(sm, masks);
+		// Resource 0 is invalid
+		for (unsigned i = 1; i < masks.size(); i++) indices[masks[i]] = i;
+	}
+
+	void onEvent(const mca::HWInstructionEvent& event) override {
+		if (event.Type != mca::HWInstructionEvent::Issued) return;
+		auto& issued = static_cast<const mca::HWInstructionIssuedEvent&>(event);
+		for (auto& use : issued.UsedResources) {
+			auto it = indices.find(use.first.first);
+			if (it != indices.end()) cycles[it->second] += use.second;
+		}
+	}
+
+	void onEvent(const mca::HWPressureEvent& event) override {
+		switch (event.Reason) {
+		case mca::HWPressureEvent::RESOURCES: resourceLimited = true; break;
+		case mca::HWPressureEvent::REGISTER_DEPS: registerLimited = true; break;
+		case mca::HWPressureEvent::MEMORY_DEPS: memoryLimited = true; break;
+		default: break;
+		}
+	}
+
+	// Pressure is counted at most once per cycle.
+	void onCycleEnd() override {
+		resourceCycles += resourceLimited;
+		registerCycles += registerLimited;
+		memoryCycles += memoryLimited;
+		resourceLimited = registerLimited = memoryLimited = false;
+	}
+
+	// An `Array ResourcePressure` of the used resources,
+	// with their cycles averaged over the given number of iterations.
+	lean_obj_res mkResourcePressure(unsigned iterations) {
+		lean_object* arr = lean_alloc_array(0, PAPYRUS_DEFAULT_ARRAY_CAPCITY);
+		for (unsigned i = 1; i < cycles.size(); i++) {
+			if (cycles[i] == 0) continue;
+			lean_object* obj = lean_alloc_ctor(0, 1, sizeof(double));
+			lean_ctor_set(obj, 0, lean_mk_string(sm.getProcResource(i)->Name));
+			lean_ctor_set_float(obj, sizeof(void*)*1, cycles[i] / iterations);
+			arr = lean_array_push(arr, obj);
+		}
+		return arr;
+	}
+
+	uint64_t resourceCycles = 0;
+	uint64_t registerCycles = 0;
+	uint64_t memoryCycles = 0;
+
+private:
+	const MCSchedModel& sm;
+	SmallVector<uint64_t, 32> masks;
+	DenseMap<uint64_t, unsigned> indices;
+	// The total cycles each resource was used for (by index).
+	SmallVector<double, 32> cycles;
+	bool resourceLimited = false;
+	bool registerLimited = false;
+	bool memoryLimited = false;
+};
+
+// Simulate the given number of iterations of the given instructions
+// on the (default subtarget of the) given target machine with MCA.
+// Returns a `ThroughputReport`.
+static lean_obj_res analyzeThroughput
+	(TargetMachine& tm, ArrayRef<MCInst> insts, unsigned iterations)
+{
+	auto& sti = *tm.getMCSubtargetInfo();
+	auto& sm = sti.getSchedModel();
+	if (!sm.hasInstrSchedModel()) {
+		return mkStdStringError("CPU '" + tm.getTargetCPU().str() +
+			"' has no scheduling model to analyze throughput with.");
+	}
+	auto& mri = *tm.getMCRegisterInfo();
+	auto& mii = *tm.getMCInstrInfo();
+	std::unique_ptr<MCInstrAnalysis> mcia(tm.getTarget().createMCInstrAnalysis(&mii));
+	mca::InstrBuilder builder(sti, mii, mri, mcia.get());
+	std::vector<std::unique_ptr<mca::Instruction>> lowered;
+	uint64_t numUops = 0;
+	for (auto& inst : insts) {
+		auto instOrErr = builder.createInstruction(inst);
+		if (!instOrErr) return mkStdStringError(toString(instOrErr.takeError()));
+		numUops += (*instOrErr)->getDesc().NumMicroOps;
+		lowered.push_back(std::move(*instOrErr));
+	}
+	mca::SourceMgr srcMgr(lowered, iterations);
+	mca::Context mca(mri, sti);
+	// Use the defaults of `llvm-mca` (i.e., those of the scheduling model)
+	mca::PipelineOptions opts(0, 0, 0, 0, 0, 0, true, true);
+#if LLVM_VERSION_MAJOR >= 13
+	mca::CustomBehaviour cb(sti, srcMgr, mii);
+	auto pipeline = mca.createDefaultPipeline(opts, srcMgr, cb);
+#else
+	auto pipeline = mca.createDefaultPipeline(opts, srcMgr);
+#endif
+	ThroughputListener listener(sm);
+	pipeline->addEventListener(&listener);
+	auto cyclesOrErr = pipeline->run();
+	if (!cyclesOrErr) return mkStdStringError(toString(cyclesOrErr.takeError()));
+	uint64_t totalCycles = *cyclesOrErr;
+	lean_object* obj = lean_alloc_ctor(0, 8, sizeof(double)*2);
+	lean_ctor_set(obj, 0, lean_box(iterations));
+	lean_ctor_set(obj, 1, lean_usize_to_nat(insts.size()));
+	lean_ctor_set(obj, 2, lean_uint64_to_nat(numUops));
+	lean_ctor_set(obj, 3, lean_uint64_to_nat(totalCycles));
+	lean_ctor_set(obj, 4, lean_uint64_to_nat(listener.resourceCycles));
+	lean_ctor_set(obj, 5, lean_uint64_to_nat(listener.registerCycles));
+	lean_ctor_set(obj, 6, lean_uint64_to_nat(listener.memoryCycles));
+	lean_ctor_set(obj, 7, listener.mkResourcePressure(iterations));
+	lean_ctor_set_float(obj, sizeof(void*)*8, totalCycles / double(iterations));
+	lean_ctor_set_float(obj, sizeof(void*)*8 + sizeof(double), totalCycles == 0 ? 0 :
+		double(insts.size()) * iterations / totalCycles);
+	return lean_io_result_mk_ok(obj);
+}
+
+// Analyze the throughput of the machine code the given execution engine
+// compiled for the given function with MCA (like `llvm-mca`),
+// simulating the given number of iterations of its instructions.
+// A slice of the instructions can be selected by index
+// (a `count` of 0 selects all instructions from `first` on).
+extern "C" lean_obj_res papyrus_execution_engine_analyze_throughput
+	(b_lean_obj_res funRef, uint32_t iterations, uint32_t first, uint32_t count,
+		b_lean_obj_res eeRef, lean_obj_arg /* w */)
+{
+	if (iterations == 0) return mkStringError("Expected at least one iteration.");
+	auto rangeOrErr = getFunctionCode(eeRef, toFunction(funRef));
+	if (!rangeOrErr) return mkStdStringError(toString(rangeOrErr.takeError()));
+	auto& tm = *toExecutionEngine(eeRef)->getTargetMachine();
+	auto decoderOrErr = createDecoder(tm);
+	if (!decoderOrErr) return mkStdStringError(toString(decoderOrErr.takeError()));
+	auto decoded = decode(**decoderOrErr, *rangeOrErr);
+	if (first > decoded.size()) {
+		return mkStringError("Instruction index is out of range.");
+	}
+	auto end = count == 0 ? decoded.size() : std::min<size_t>(decoded.size(), first + count);
+	std::vector<MCInst> insts;
+	for (size_t i = first; i < end; i++) {
+		if (!decoded[i].valid) {
+			return mkStdStringError("Could not decode the instruction at 0x" +
+				utohexstr(decoded[i].addr) + ".");
+		}
+		insts.push_back(decoded[i].inst);
+	}
+	if (insts.empty()) return mkStringError("No instructions to analyze.");
+	return analyzeThroughput(tm, insts, iterations);
+}
+
+} // end namespace papyrus
@@ -1,9 +1,11 @@
 #include "papyrus.h"
 #include "papyrus_ffi.h"
+#include "papyrus_ostream.h"
 
 #include <lean/lean.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/raw_ostream.h>
 
 using namespace llvm;
@@ -34,6 +36,7 @@ extern "C" lean_obj_res papyrus_module_new
 {
 	auto ctx = toLLVMContext(ctxRef);
 	auto mod = new llvm::Module(refOfString(modIdObj), *ctx);
+	counters.modulesCreated.fetch_add(1, std::memory_order_relaxed);
 	return lean_io_result_mk_ok(mkModuleRef(ctxRef, mod));
 }
 
@@ -144,6 +147,24 @@ extern "C" lean_obj_res papyrus_module_append_function
 	return lean_io_result_mk_ok(lean_box(0));
 }
 
+// Get the number of functions, global variables, basic blocks,
+// and instructions in the given module.
+extern "C" lean_obj_res papyrus_module_get_stats
+	(b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+	auto mod = toModule(modRef);
+	uint64_t numBlocks = 0;
+	for (Function& fn : *mod) {
+		numBlocks += fn.size();
+	}
+	lean_object* obj = lean_alloc_ctor(0, 0, 4*sizeof(uint64_t));
+	lean_ctor_set_uint64(obj, 0, mod->size());
+	lean_ctor_set_uint64(obj, sizeof(uint64_t), mod->global_size());
+	lean_ctor_set_uint64(obj, 2*sizeof(uint64_t), numBlocks);
+	lean_ctor_set_uint64(obj, 3*sizeof(uint64_t), mod->getInstructionCount());
+	return lean_io_result_mk_ok(obj);
+}
+
 // Check the given module for errors.
 // Errors are reported inside the `IO` monad.
 // If `warnBrokenDebugInfo` is true, DebugInfo verification failures won't be
@@ -152,6 +173,7 @@ extern "C" lean_obj_res papyrus_module_append_function
 extern "C" lean_obj_res papyrus_module_verify
 	(b_lean_obj_res modRef, uint8_t warnBrokenDebugInfo,  lean_obj_arg /* w */)
 {
+	PhaseScope phase(Phase::Verify, toModule(modRef)->getModuleIdentifier());
 	std::string ostr;
 	raw_string_ostream out(ostr);
 	if (warnBrokenDebugInfo) {
@@ -175,6 +197,7 @@ extern "C" lean_obj_res papyrus_module_print
 	(b_lean_obj_res modRef, uint8_t shouldPreserveUseListOrder, uint8_t isForDebug,
 		lean_obj_arg /* w */)
 {
+	PhaseScope phase(Phase::Print, toModule(modRef)->getModuleIdentifier());
 	toModule(modRef)->print(llvm::outs(), nullptr, shouldPreserveUseListOrder, isForDebug);
 	return lean_io_result_mk_ok(lean_box(0));
 }
@@ -184,19 +207,82 @@ extern "C" lean_obj_res papyrus_module_eprint
 	(b_lean_obj_res modRef, uint8_t shouldPreserveUseListOrder, uint8_t isForDebug,
 		lean_obj_arg /* w */)
 {
+	PhaseScope phase(Phase::Print, toModule(modRef)->getModuleIdentifier());
 	toModule(modRef)->print(llvm::errs(), nullptr, shouldPreserveUseListOrder, isForDebug);
 	return lean_io_result_mk_ok(lean_box(0));
 }
 
 // Print the given module to a string.
+// The module is printed straight into the buffer of the Lean string.
 extern "C" lean_obj_res papyrus_module_sprint
 	(b_lean_obj_res modRef, uint8_t shouldPreserveUseListOrder, uint8_t isForDebug,
 		lean_obj_arg /* w */)
 {
-	std::string ostr;
-	raw_string_ostream out(ostr);
+	auto mod = toModule(modRef);
+	PhaseScope phase(Phase::Print, mod->getModuleIdentifier());
+	// Printed IR averages a few dozen bytes per instruction.
+	LeanStringOstream out(1024 + 32 * mod->getInstructionCount());
+	mod->print(out, nullptr, shouldPreserveUseListOrder, isForDebug);
+	return lean_io_result_mk_ok(out.take());
+}
+
+// Print the given module to the file at the given path,
+// overwriting it if it already exists.
+extern "C" lean_obj_res papyrus_module_print_to_file
+	(b_lean_obj_res modRef, b_lean_obj_res fnameObj,
+		uint8_t shouldPreserveUseListOrder, uint8_t isForDebug, lean_obj_arg /* w */)
+{
+	PhaseScope phase(Phase::Print, toModule(modRef)->getModuleIdentifier());
+	std::error_code ec;
+	raw_fd_ostream out(refOfString(fnameObj), ec, sys::fs::OF_Text);
+	if (ec) return lean_io_result_mk_error(lean_decode_io_error(ec.value(), fnameObj));
+	toModule(modRef)->print(out, nullptr, shouldPreserveUseListOrder, isForDebug);
+	out.close();
+	if (out.has_error()) {
+		ec = out.error();
+		out.clear_error();
+		return lean_io_result_mk_error(lean_decode_io_error(ec.value(), fnameObj));
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Print the given module to the given (open) file descriptor.
+// The descriptor is flushed but not closed.
+extern "C" lean_obj_res papyrus_module_print_to_fd
+	(b_lean_obj_res modRef, uint32_t fd,
+		uint8_t shouldPreserveUseListOrder, uint8_t isForDebug, lean_obj_arg /* w */)
+{
+	PhaseScope phase(Phase::Print, toModule(modRef)->getModuleIdentifier());
+	raw_fd_ostream out(fd, false);
 	toModule(modRef)->print(out, nullptr, shouldPreserveUseListOrder, isForDebug);
-	return lean_io_result_mk_ok(mkStringFromStd(out.str()));
+	out.flush();
+	if (out.has_error()) {
+		auto ec = out.error();
+		out.clear_error();
+		// Like Lean's own handle errors, these have no file name
+		return lean_io_result_mk_error(lean_decode_io_error(ec.value(), nullptr));
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Print each function definition of the given module to a separate string.
+// Each function is numbered independently, so the strings of functions
+// with metadata attachments do not form a parseable module when joined.
+// LLVM does not guarantee that printing is thread safe within a context
+// (e.g., it lazily numbers shared metadata), so functions are printed serially.
+extern "C" lean_obj_res papyrus_module_sprint_functions
+	(b_lean_obj_res modRef, uint8_t isForDebug, lean_obj_arg /* w */)
+{
+	auto mod = toModule(modRef);
+	PhaseScope phase(Phase::Print, mod->getModuleIdentifier());
+	lean_object* arr = lean_alloc_array(0, mod->size());
+	for (auto& fn : *mod) {
+		if (fn.isDeclaration()) continue;
+		LeanStringOstream out(256 + 32 * fn.getInstructionCount());
+		fn.print(out, nullptr, false, isForDebug);
+		arr = lean_array_push(arr, out.take());
+	}
+	return lean_io_result_mk_ok(arr);
 }
 
 } // end namespace papyrus
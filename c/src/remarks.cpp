@@ -0,0 +1,247 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+
+#include <mutex>
+#include <vector>
+#include <lean/lean.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LLVMRemarkStreamer.h>
+#include <llvm/Remarks/RemarkStreamer.h>
+#include <llvm/Support/Regex.h>
+#include <llvm/Support/ToolOutputFile.h>
+
+using namespace llvm;
+
+namespace papyrus {
+
+//------------------------------------------------------------------------------
+// Remark collectors
+//------------------------------------------------------------------------------
+
+// The kinds of optimization remarks.
+// Must be kept in sync with `Papyrus.RemarkKind` in Lean.
+enum class RemarkKind : uint8_t {
+	Passed,
+	Missed,
+	Analysis,
+};
+
+// The formats remarks can be written to a file in.
+// Must be kept in sync with `Papyrus.RemarkFormat` in Lean.
+static const char* remarkFormatNames[] = {"yaml", "bitstream"};
+
+// An optimization remark copied out of LLVM's diagnostic.
+// Remarks may be emitted by background compile threads,
+// so they are only converted to Lean objects when collected.
+struct CollectedRemark {
+	RemarkKind kind;
+	std::string passName;
+	std::string name;
+	std::string function;
+	DiagnosticLocation loc;
+	std::vector<std::pair<std::string, std::string>> args;
+};
+
+// Collects the optimization remarks of the passes matching a regex
+// that are emitted in a context while it is active.
+// Remarks can also be written to a file with LLVM's remark streamer.
+class RemarkCollector {
+public:
+	RemarkCollector(LLVMContext& ctx, StringRef passes)
+		: ctx(ctx), passes(passes) {}
+
+	RemarkCollector(const RemarkCollector&) = delete;
+
+	~RemarkCollector() {
+		if (handler && !stop()) {
+			// Another handler sits on top of this one, so it stays installed
+			// (disabled). The context's remark streamer may still write to
+			// the file, so the handler keeps it open.
+			handler->owner = nullptr;
+			if (file) file->keep();
+			handler->file = std::move(file);
+		}
+	}
+
+	// Start writing the collected remarks to the given file.
+	Error startFile(StringRef fileName, StringRef format, StringRef passRegex) {
+		auto fileOrErr = setupLLVMOptimizationRemarks(ctx, fileName, passRegex, format, false);
+		if (!fileOrErr) return fileOrErr.takeError();
+		file = std::move(*fileOrErr);
+		return Error::success();
+	}
+
+	// Install the collector as the context's diagnostic handler.
+	void start() {
+		auto h = std::make_unique<Handler>(this, ctx.getDiagnosticHandler());
+		handler = h.get();
+		ctx.setDiagnosticHandler(std::move(h));
+	}
+
+	// Uninstall the collector (and close its file, if any).
+	// Fails if another handler was installed on top of it in the meantime.
+	bool stop() {
+		if (!handler) return true;
+		if (ctx.getDiagHandlerPtr() != handler) return false;
+		ctx.setDiagnosticHandler(std::move(handler->prev));
+		handler = nullptr;
+		if (file) {
+			ctx.setLLVMRemarkStreamer(nullptr);
+			ctx.setMainRemarkStreamer(nullptr);
+			file->keep();
+			file.reset();
+		}
+		return true;
+	}
+
+	// Take the remarks collected so far.
+	std::vector<CollectedRemark> take() {
+		std::vector<CollectedRemark> out;
+		std::lock_guard<std::mutex> lock(mutex);
+		out.swap(remarks);
+		return out;
+	}
+
+private:
+	struct Handler : public DiagnosticHandler {
+		RemarkCollector* owner;
+		std::unique_ptr<DiagnosticHandler> prev;
+		// The remark file of a collector destroyed while not on top.
+		std::unique_ptr<ToolOutputFile> file;
+
+		Handler(RemarkCollector* owner, std::unique_ptr<DiagnosticHandler> prev)
+			: owner(owner), prev(std::move(prev)) {}
+
+		bool isEnabled(StringRef passName) const {
+			return owner && owner->passes.match(passName);
+		}
+		bool isAnalysisRemarkEnabled(StringRef passName) const override {
+			return isEnabled(passName);
+		}
+		bool isMissedOptRemarkEnabled(StringRef passName) const override {
+			return isEnabled(passName);
+		}
+		bool isPassedOptRemarkEnabled(StringRef passName) const override {
+			return isEnabled(passName);
+		}
+		bool isAnyRemarkEnabled() const override {
+			return owner != nullptr;
+		}
+
+		bool handleDiagnostics(const DiagnosticInfo& info) override {
+			auto remark = dyn_cast<DiagnosticInfoOptimizationBase>(&info);
+			if (!remark) return prev && prev->handleDiagnostics(info);
+			if (isEnabled(remark->getPassName())) owner->add(*remark);
+			return true;
+		}
+	};
+
+	void add(const DiagnosticInfoOptimizationBase& remark) {
+		CollectedRemark out;
+		out.kind = remark.isPassed() ? RemarkKind::Passed :
+			remark.isMissed() ? RemarkKind::Missed : RemarkKind::Analysis;
+		out.passName = remark.getPassName().str();
+		out.name = remark.getRemarkName().str();
+		out.function = remark.getFunction().getName().str();
+		out.loc = remark.getLocation();
+		for (auto& arg : remark.getArgs()) out.args.emplace_back(arg.Key, arg.Val);
+		std::lock_guard<std::mutex> lock(mutex);
+		remarks.push_back(std::move(out));
+	}
+
+	LLVMContext& ctx;
+	Regex passes;
+	Handler* handler = nullptr;
+	std::unique_ptr<ToolOutputFile> file;
+	std::mutex mutex;
+	std::vector<CollectedRemark> remarks;
+};
+
+RemarkCollector* toRemarkCollector(b_lean_obj_arg ref) {
+	return fromLinkedOwnedPtr<RemarkCollector>(ref);
+}
+
+// Start collecting the remarks of the passes matching the given regex
+// in the given context. If the file name is not empty,
+// the remarks are also written to it in the given format.
+extern "C" lean_obj_res papyrus_remark_collector_start
+	(b_lean_obj_res passesObj, b_lean_obj_res fileObj, uint8_t format,
+		lean_obj_arg ctxRef, lean_obj_arg /* w */)
+{
+	auto passes = refOfString(passesObj);
+	std::string err;
+	if (!Regex(passes).isValid(err)) {
+		lean_dec_ref(ctxRef);
+		return mkStdStringError("Invalid pass regex: " + err);
+	}
+	auto ctx = toLLVMContext(ctxRef);
+	auto collector = std::make_unique<RemarkCollector>(*ctx, passes);
+	auto fileName = refOfString(fileObj);
+	if (!fileName.empty()) {
+		auto fileErr = collector->startFile(fileName, remarkFormatNames[format], passes);
+		if (fileErr) {
+			lean_dec_ref(ctxRef);
+			return mkStdStringError(toString(std::move(fileErr)));
+		}
+	}
+	collector->start();
+	return lean_io_result_mk_ok(mkLinkedOwnedPtr<RemarkCollector>(ctxRef, collector.release()));
+}
+
+// Convert a collected remark to a Lean `Remark`.
+static lean_obj_res mkRemark(const CollectedRemark& remark) {
+	lean_object* loc = lean_box(0);
+	if (remark.loc.isValid()) {
+		lean_object* locObj = lean_alloc_ctor(0, 1, 8);
+		lean_ctor_set(locObj, 0, mkStringFromRef(remark.loc.getRelativePath()));
+		lean_ctor_set_uint32(locObj, sizeof(void*)*1, remark.loc.getLine());
+		lean_ctor_set_uint32(locObj, sizeof(void*)*1 + 4, remark.loc.getColumn());
+		loc = mkSome(locObj);
+	}
+	lean_object* args = lean_alloc_array(0, remark.args.size());
+	for (auto& arg : remark.args) {
+		lean_object* argObj = lean_alloc_ctor(0, 2, 0);
+		lean_ctor_set(argObj, 0, mkStringFromStd(arg.first));
+		lean_ctor_set(argObj, 1, mkStringFromStd(arg.second));
+		args = lean_array_push(args, argObj);
+	}
+	lean_object* obj = lean_alloc_ctor(0, 5, 1);
+	lean_ctor_set(obj, 0, mkStringFromStd(remark.passName));
+	lean_ctor_set(obj, 1, mkStringFromStd(remark.name));
+	lean_ctor_set(obj, 2, mkStringFromStd(remark.function));
+	lean_ctor_set(obj, 3, loc);
+	lean_ctor_set(obj, 4, args);
+	lean_ctor_set_uint8(obj, sizeof(void*)*5, static_cast<uint8_t>(remark.kind));
+	return obj;
+}
+
+// Convert collected remarks to a Lean `Array Remark`.
+static lean_obj_res mkRemarkArray(const std::vector<CollectedRemark>& remarks) {
+	lean_object* arr = lean_alloc_array(0, remarks.size());
+	for (auto& remark : remarks) arr = lean_array_push(arr, mkRemark(remark));
+	return arr;
+}
+
+// Stop collecting remarks (and close the remark file, if any)
+// and get the remarks collected.
+extern "C" lean_obj_res papyrus_remark_collector_stop
+	(b_lean_obj_res collectorRef, lean_obj_arg /* w */)
+{
+	auto collector = toRemarkCollector(collectorRef);
+	if (!collector->stop()) {
+		return mkStringError(
+			"Remark collectors must be stopped in the reverse order they were started.");
+	}
+	return lean_io_result_mk_ok(mkRemarkArray(collector->take()));
+}
+
+// Take the remarks collected so far without stopping the collector.
+extern "C" lean_obj_res papyrus_remark_collector_take
+	(b_lean_obj_res collectorRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(mkRemarkArray(toRemarkCollector(collectorRef)->take()));
+}
+
+} // end namespace papyrus
@@ -0,0 +1,336 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+
+#include <algorithm>
+#include <vector>
+#include <lean/lean.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/PatternMatch.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+namespace papyrus {
+
+//------------------------------------------------------------------------------
+// Compiled rules
+//------------------------------------------------------------------------------
+
+// A node of a compiled pattern.
+// Must be kept in sync with `Papyrus.Pattern` in Lean.
+struct PatternNode {
+	enum Kind : uint8_t { Var, Int, Inst } kind;
+	unsigned var = 0;
+	int64_t intVal = 0;
+	unsigned opcode = 0;
+	std::vector<PatternNode> ops;
+};
+
+// A node of a compiled replacement.
+// Must be kept in sync with `Papyrus.Replacement` in Lean.
+struct ReplacementNode {
+	enum Kind : uint8_t { Var, Int, BinOp } kind;
+	unsigned var = 0;
+	int64_t intVal = 0;
+	unsigned opcode = 0;
+	std::vector<ReplacementNode> ops;
+};
+
+struct RewriteRule {
+	std::string name;
+	PatternNode pattern;
+	ReplacementNode replacement;
+	unsigned numVars;
+};
+
+// A set of rewrite rules indexed by the opcode of their root instruction.
+struct RewriteRules {
+	std::vector<RewriteRule> rules;
+	DenseMap<unsigned, SmallVector<unsigned, 4>> byOpcode;
+};
+
+RewriteRules* toRewriteRules(b_lean_obj_arg ref) {
+	return fromOwnedPtr<RewriteRules>(ref);
+}
+
+// Compile a Lean integer constant of a rule.
+static Expected<int64_t> compileInt(b_lean_obj_arg intObj) {
+	if (!lean_is_scalar(intObj)) {
+		return createStringError(inconvertibleErrorCode(),
+			"Integer constants of rewrite rules must fit in a machine word.");
+	}
+	return lean_scalar_to_int64(intObj);
+}
+
+// Compile a Lean `Pattern`, recording the number of variables it binds.
+static Expected<PatternNode> compilePattern(b_lean_obj_arg obj, unsigned& numVars) {
+	PatternNode node;
+	node.kind = static_cast<PatternNode::Kind>(lean_obj_tag(obj));
+	switch (node.kind) {
+	case PatternNode::Var:
+		node.var = lean_unbox(lean_ctor_get(obj, 0));
+		numVars = std::max(numVars, node.var + 1);
+		break;
+	case PatternNode::Int: {
+		auto val = compileInt(lean_ctor_get(obj, 0));
+		if (!val) return val.takeError();
+		node.intVal = *val;
+		break;
+	}
+	case PatternNode::Inst:
+		node.opcode = lean_ctor_get_uint8(obj, sizeof(void*)*1) + 1;
+		if (node.opcode == Instruction::PHI) {
+			// Replacements are built before the root of the match, which a PHI's
+			// incoming values need not dominate (and a root PHI would get
+			// the replacement among the PHIs of its block)
+			return createStringError(inconvertibleErrorCode(),
+				"Patterns may not match PHIs.");
+		}
+		for (auto opObj : viewArray(lean_ctor_get(obj, 0))) {
+			auto op = compilePattern(opObj, numVars);
+			if (!op) return op.takeError();
+			node.ops.push_back(std::move(*op));
+		}
+		break;
+	}
+	return node;
+}
+
+// Compile a Lean `Replacement` whose variables must be bound by the pattern.
+static Expected<ReplacementNode> compileReplacement(b_lean_obj_arg obj, unsigned numVars) {
+	ReplacementNode node;
+	node.kind = static_cast<ReplacementNode::Kind>(lean_obj_tag(obj));
+	switch (node.kind) {
+	case ReplacementNode::Var:
+		node.var = lean_unbox(lean_ctor_get(obj, 0));
+		if (node.var >= numVars) {
+			return createStringError(inconvertibleErrorCode(),
+				"Replacement uses a variable the pattern does not bind.");
+		}
+		break;
+	case ReplacementNode::Int: {
+		auto val = compileInt(lean_ctor_get(obj, 0));
+		if (!val) return val.takeError();
+		node.intVal = *val;
+		break;
+	}
+	case ReplacementNode::BinOp:
+		node.opcode = lean_ctor_get_uint8(obj, sizeof(void*)*2) + 1;
+		if (!Instruction::isBinaryOp(node.opcode)) {
+			return createStringError(inconvertibleErrorCode(),
+				"Replacement instructions must be binary operators.");
+		}
+		for (unsigned i = 0; i < 2; i++) {
+			auto op = compileReplacement(lean_ctor_get(obj, i), numVars);
+			if (!op) return op.takeError();
+			node.ops.push_back(std::move(*op));
+		}
+		break;
+	}
+	return node;
+}
+
+// Compile a Lean `RewriteRule`.
+static Expected<RewriteRule> compileRule(b_lean_obj_arg obj) {
+	RewriteRule rule;
+	rule.name = stdOfString(lean_ctor_get(obj, 0));
+	rule.numVars = 0;
+	auto pattern = compilePattern(lean_ctor_get(obj, 1), rule.numVars);
+	if (!pattern) {
+		return createStringError(inconvertibleErrorCode(), "Rule '" + rule.name +
+			"': " + toString(pattern.takeError()));
+	}
+	if (pattern->kind != PatternNode::Inst) {
+		return createStringError(inconvertibleErrorCode(),
+			"Pattern of rule '" + rule.name + "' does not match an instruction.");
+	}
+	rule.pattern = std::move(*pattern);
+	auto replacement = compileReplacement(lean_ctor_get(obj, 2), rule.numVars);
+	if (!replacement) {
+		return createStringError(inconvertibleErrorCode(), "Rule '" + rule.name +
+			"': " + toString(replacement.takeError()));
+	}
+	rule.replacement = std::move(*replacement);
+	return rule;
+}
+
+// Compile an array of Lean rewrite rules into an owned rule set.
+extern "C" lean_obj_res papyrus_rewrite_rules_compile
+	(b_lean_obj_res rulesObj, lean_obj_arg /* w */)
+{
+	auto rules = std::make_unique<RewriteRules>();
+	for (auto ruleObj : viewArray(rulesObj)) {
+		auto rule = compileRule(ruleObj);
+		if (!rule) return mkStdStringError(toString(rule.takeError()));
+		rules->byOpcode[rule->pattern.opcode].push_back(rules->rules.size());
+		rules->rules.push_back(std::move(*rule));
+	}
+	return lean_io_result_mk_ok(mkOwnedPtr<RewriteRules>(rules.release()));
+}
+
+// Get the number of rules in the given rule set.
+extern "C" lean_obj_res papyrus_rewrite_rules_get_size
+	(b_lean_obj_res rulesRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(lean_usize_to_nat(toRewriteRules(rulesRef)->rules.size()));
+}
+
+//------------------------------------------------------------------------------
+// Matching
+//------------------------------------------------------------------------------
+
+using Bindings = SmallVector<Value*, 8>;
+
+// Check whether an integer constant of a rule fits in the given bit width
+// (as either a signed or an unsigned integer).
+static bool fitsInWidth(int64_t val, unsigned width) {
+	APInt wide(64, val, true);
+	return wide.isSignedIntN(width) || wide.isIntN(width);
+}
+
+static bool matchPattern(const PatternNode& p, Value* v, Bindings& binds);
+
+// Match the operands of an instruction in the given order.
+static bool matchOperands(const PatternNode& p, Instruction* inst,
+	Bindings& binds, bool swap)
+{
+	for (unsigned i = 0, n = p.ops.size(); i < n; i++) {
+		auto op = inst->getOperand(swap ? n - 1 - i : i);
+		if (!matchPattern(p.ops[i], op, binds)) return false;
+	}
+	return true;
+}
+
+static bool matchPattern(const PatternNode& p, Value* v, Bindings& binds) {
+	switch (p.kind) {
+	case PatternNode::Var:
+		if (!binds[p.var]) {
+			binds[p.var] = v;
+			return true;
+		}
+		return binds[p.var] == v;
+	case PatternNode::Int: {
+		const APInt* c;
+		if (!match(v, m_APInt(c))) return false;
+		if (!fitsInWidth(p.intVal, c->getBitWidth())) return false;
+		return APInt::isSameValue(*c, APInt(64, p.intVal, true).sextOrTrunc(c->getBitWidth()));
+	}
+	case PatternNode::Inst: {
+		auto inst = dyn_cast<Instruction>(v);
+		if (!inst || inst->getOpcode() != p.opcode) return false;
+		if (inst->getNumOperands() != p.ops.size()) return false;
+		if (!inst->isCommutative() || p.ops.size() != 2)
+			return matchOperands(p, inst, binds, false);
+		auto saved = binds;
+		if (matchOperands(p, inst, binds, false)) return true;
+		binds = std::move(saved);
+		return matchOperands(p, inst, binds, true);
+	}
+	}
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// Replacement
+//------------------------------------------------------------------------------
+
+// Check whether the replacement can produce a value of the given type.
+static bool checkReplacement(const ReplacementNode& r, Type* type, const Bindings& binds) {
+	switch (r.kind) {
+	case ReplacementNode::Var:
+		return binds[r.var]->getType() == type;
+	case ReplacementNode::Int:
+		return type->isIntOrIntVectorTy() &&
+			fitsInWidth(r.intVal, type->getScalarSizeInBits());
+	case ReplacementNode::BinOp:
+		return isValidBinaryOp(r.opcode, type) &&
+			checkReplacement(r.ops[0], type, binds) &&
+			checkReplacement(r.ops[1], type, binds);
+	}
+	return false;
+}
+
+// Build the (type-checked) replacement with the given builder,
+// recording the instructions it creates.
+static Value* buildReplacement(const ReplacementNode& r, Type* type,
+	const Bindings& binds, IRBuilder<>& builder, SmallVectorImpl<WeakVH>& created)
+{
+	switch (r.kind) {
+	case ReplacementNode::Var:
+		return binds[r.var];
+	case ReplacementNode::Int:
+		return ConstantInt::get(type, r.intVal, true);
+	case ReplacementNode::BinOp: {
+		auto lhs = buildReplacement(r.ops[0], type, binds, builder, created);
+		auto rhs = buildReplacement(r.ops[1], type, binds, builder, created);
+		auto val = builder.CreateBinOp(static_cast<Instruction::BinaryOps>(r.opcode), lhs, rhs);
+		if (isa<Instruction>(val)) created.push_back(val);
+		return val;
+	}
+	}
+	return nullptr;
+}
+
+// Try to rewrite the given instruction with the first matching rule.
+// Returns the index of the rule that fired (if any).
+static Optional<unsigned> rewriteInstruction(RewriteRules& rules, Instruction* inst,
+	SmallVectorImpl<WeakVH>& worklist)
+{
+	if (inst->getType()->isVoidTy()) return None;
+	auto candidates = rules.byOpcode.find(inst->getOpcode());
+	if (candidates == rules.byOpcode.end()) return None;
+	Bindings binds;
+	for (auto idx : candidates->second) {
+		auto& rule = rules.rules[idx];
+		binds.assign(rule.numVars, nullptr);
+		if (!matchPattern(rule.pattern, inst, binds)) continue;
+		if (!checkReplacement(rule.replacement, inst->getType(), binds)) continue;
+		IRBuilder<> builder(inst);
+		auto val = buildReplacement(rule.replacement, inst->getType(), binds, builder, worklist);
+		if (isa<Instruction>(val) && !val->hasName()) val->takeName(inst);
+		for (auto user : inst->users()) worklist.push_back(user);
+		inst->replaceAllUsesWith(val);
+		RecursivelyDeleteTriviallyDeadInstructions(inst);
+		return idx;
+	}
+	return None;
+}
+
+// Rewrite the given function (which must be a definition) with the given
+// rules until none match or the given number of rewrites have been made.
+// Returns how many times each rule fired.
+extern "C" lean_obj_res papyrus_function_rewrite
+	(b_lean_obj_res funRef, b_lean_obj_res rulesRef, uint32_t maxRewrites,
+		lean_obj_arg /* w */)
+{
+	auto fn = toFunction(funRef);
+	if (fn->isDeclaration()) return mkStringError("Cannot rewrite a function declaration.");
+	auto& rules = *toRewriteRules(rulesRef);
+	std::vector<size_t> counts(rules.rules.size(), 0);
+	// Pop instructions in program order, so operands are rewritten before their users.
+	SmallVector<WeakVH, 64> worklist;
+	for (auto& inst : instructions(*fn)) worklist.push_back(&inst);
+	std::reverse(worklist.begin(), worklist.end());
+	uint32_t numRewrites = 0;
+	while (!worklist.empty() && numRewrites < maxRewrites) {
+		auto inst = dyn_cast_or_null<Instruction>(worklist.pop_back_val());
+		if (!inst || !inst->getParent()) continue;
+		if (auto idx = rewriteInstruction(rules, inst, worklist)) {
+			counts[*idx]++;
+			numRewrites++;
+		}
+	}
+	lean_object* arr = lean_alloc_array(0, counts.size());
+	for (auto count : counts) arr = lean_array_push(arr, lean_usize_to_nat(count));
+	return lean_io_result_mk_ok(arr);
+}
+
+} // end namespace papyrus
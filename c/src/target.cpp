@@ -0,0 +1,371 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+
+#include <mutex>
+#include <lean/lean.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#if LLVM_VERSION_MAJOR >= 14
+#include <llvm/MC/TargetRegistry.h>
+#else
+#include <llvm/Support/TargetRegistry.h>
+#endif
+
+using namespace llvm;
+
+namespace papyrus {
+
+//------------------------------------------------------------------------------
+// Target machines
+//------------------------------------------------------------------------------
+
+// A target machine along with a scratch function
+// for answering target-level cost queries without a user function.
+struct TMExternal {
+	std::unique_ptr<TargetMachine> tm;
+	LLVMContext ctx;
+	std::unique_ptr<Module> scratch;
+	Function* scratchFn;
+
+	TMExternal(TargetMachine* tm) : tm(tm) {
+		scratch = std::make_unique<Module>("papyrus.target", ctx);
+		scratch->setDataLayout(tm->createDataLayout());
+		scratch->setTargetTriple(tm->getTargetTriple().str());
+		scratchFn = Function::Create(FunctionType::get(Type::getVoidTy(ctx), false),
+			GlobalValue::ExternalLinkage, "papyrus.target", *scratch);
+	}
+
+	TMExternal(const TMExternal&) = delete;
+
+	// The cost model of the target for the given function
+	// (or for functions with the target's default attributes).
+	TargetTransformInfo getTTI(const Function* fn = nullptr) {
+		return tm->getTargetTransformInfo(fn ? *fn : *scratchFn);
+	}
+};
+
+TMExternal* toTMExternal(b_lean_obj_arg ref) {
+	return fromOwnedPtr<TMExternal>(ref);
+}
+
+TargetMachine* toTargetMachine(b_lean_obj_arg ref) {
+	return toTMExternal(ref)->tm.get();
+}
+
+// Create a target machine for the given triple, CPU, and features.
+static Expected<TargetMachine*> createTargetMachine(const std::string& triple,
+	StringRef cpu, StringRef features, uint8_t optLevel)
+{
+	std::string err;
+	auto target = TargetRegistry::lookupTarget(triple, err);
+	if (!target) return createStringError(inconvertibleErrorCode(), err);
+	auto tm = target->createTargetMachine(triple, cpu, features,
+		TargetOptions(), Reloc::PIC_, None, static_cast<CodeGenOpt::Level>(optLevel));
+	if (!tm) {
+		return createStringError(inconvertibleErrorCode(),
+			"Could not create a target machine for '" + triple + "'.");
+	}
+	return tm;
+}
+
+// Create a target machine for the host's triple, CPU, and CPU features.
+static Expected<TargetMachine*> createHostTargetMachine(uint8_t optLevel) {
+	SubtargetFeatures features;
+	StringMap<bool> hostFeatures;
+	if (sys::getHostCPUFeatures(hostFeatures)) {
+		for (auto& feature : hostFeatures) {
+			features.AddFeature(feature.first(), feature.second);
+		}
+	}
+	return createTargetMachine(sys::getProcessTriple(),
+		sys::getHostCPUName(), features.getString(), optLevel);
+}
+
+// Wrap a newly created target machine in a Lean object (or report its error).
+static lean_obj_res mkTargetMachineRef(Expected<TargetMachine*> tm) {
+	if (!tm) return mkStdStringError(toString(tm.takeError()));
+	return lean_io_result_mk_ok(mkOwnedPtr<TMExternal>(new TMExternal(*tm)));
+}
+
+// Create a target machine for the given triple, CPU, and features
+// (e.g., `+avx2,-sse4a`). The target must have been initialized.
+extern "C" lean_obj_res papyrus_target_machine_create
+	(b_lean_obj_res tripleObj, b_lean_obj_res cpuObj, b_lean_obj_res featuresObj,
+		uint8_t optLevel, lean_obj_arg /* w */)
+{
+	return mkTargetMachineRef(createTargetMachine(Triple::normalize(refOfString(tripleObj)),
+		refOfString(cpuObj), refOfString(featuresObj), optLevel));
+}
+
+// Create a target machine for the host's triple, CPU, and CPU features.
+// The native target must have been initialized.
+extern "C" lean_obj_res papyrus_target_machine_create_host
+	(uint8_t optLevel, lean_obj_arg /* w */)
+{
+	return mkTargetMachineRef(createHostTargetMachine(optLevel));
+}
+
+// Get the target triple of the given target machine.
+extern "C" lean_obj_res papyrus_target_machine_get_triple
+	(b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(mkStringFromStd(toTargetMachine(tmRef)->getTargetTriple().str()));
+}
+
+// Get the CPU of the given target machine.
+extern "C" lean_obj_res papyrus_target_machine_get_cpu
+	(b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(mkStringFromRef(toTargetMachine(tmRef)->getTargetCPU()));
+}
+
+// Get the CPU features of the given target machine.
+extern "C" lean_obj_res papyrus_target_machine_get_features
+	(b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(mkStringFromRef(toTargetMachine(tmRef)->getTargetFeatureString()));
+}
+
+//------------------------------------------------------------------------------
+// Cost model queries
+//------------------------------------------------------------------------------
+
+// Wrap a cost in an `Option Nat` (`none` if it is invalid).
+static lean_obj_res mkCost(InstructionCost cost) {
+	auto value = cost.getValue();
+	if (!value || *value < 0) return lean_box(0);
+	return mkSome(lean_uint64_to_nat(*value));
+}
+
+// Get the register, register file, and cache parameters of the given
+// target machine's default subtarget as a `TargetInfo`.
+extern "C" lean_obj_res papyrus_target_machine_get_info
+	(b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	auto tti = toTMExternal(tmRef)->getTTI();
+#if LLVM_VERSION_MAJOR >= 13
+	uint64_t scalarBits = tti.getRegisterBitWidth(TargetTransformInfo::RGK_Scalar).getFixedSize();
+	uint64_t vectorBits = tti.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector).getFixedSize();
+#else
+	uint64_t scalarBits = tti.getRegisterBitWidth(false);
+	uint64_t vectorBits = tti.getRegisterBitWidth(true);
+#endif
+	lean_object* obj = lean_alloc_ctor(0, 6, 0);
+	lean_ctor_set(obj, 0, lean_uint64_to_nat(scalarBits));
+	lean_ctor_set(obj, 1, lean_uint64_to_nat(vectorBits));
+	lean_ctor_set(obj, 2, lean_uint64_to_nat(tti.getMinVectorRegisterBitWidth()));
+	lean_ctor_set(obj, 3, lean_uint64_to_nat(
+		tti.getNumberOfRegisters(tti.getRegisterClassForType(false))));
+	lean_ctor_set(obj, 4, lean_uint64_to_nat(
+		tti.getNumberOfRegisters(tti.getRegisterClassForType(true))));
+	lean_ctor_set(obj, 5, lean_uint64_to_nat(tti.getCacheLineSize()));
+	return lean_io_result_mk_ok(obj);
+}
+
+// Get the cost of the given instruction (which must be in a function)
+// of the given kind on the given target machine.
+extern "C" lean_obj_res papyrus_target_machine_get_instruction_cost
+	(b_lean_obj_res instRef, uint8_t costKind, b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	auto inst = toInstruction(instRef);
+	auto fn = inst->getFunction();
+	if (!fn) return mkStringError("Instruction is not in a function.");
+	InstructionCost cost = toTMExternal(tmRef)->getTTI(fn).getInstructionCost(inst,
+		static_cast<TargetTransformInfo::TargetCostKind>(costKind));
+	return lean_io_result_mk_ok(mkCost(cost));
+}
+
+// Get the cost of a call of the named intrinsic with the given
+// return and parameter types on the given target machine.
+extern "C" lean_obj_res papyrus_target_machine_get_intrinsic_cost
+	(b_lean_obj_res nameObj, b_lean_obj_res retTypeRef, b_lean_obj_res paramTypesObj,
+		uint8_t costKind, b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	auto id = Function::lookupIntrinsicID(refOfString(nameObj));
+	if (id == Intrinsic::not_intrinsic) {
+		return mkStringError("Unknown intrinsic.");
+	}
+	auto paramTypes = unpackArray<Type*>(paramTypesObj, toType);
+	IntrinsicCostAttributes attrs(id, toType(retTypeRef), ArrayRef<Type*>(paramTypes));
+	InstructionCost cost = toTMExternal(tmRef)->getTTI().getIntrinsicInstrCost(attrs,
+		static_cast<TargetTransformInfo::TargetCostKind>(costKind));
+	return lean_io_result_mk_ok(mkCost(cost));
+}
+
+// Get whether the given type is legal (i.e., fits in a register)
+// on the given target machine.
+extern "C" lean_obj_res papyrus_target_machine_is_type_legal
+	(b_lean_obj_res typeRef, b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	auto legal = toTMExternal(tmRef)->getTTI().isTypeLegal(toType(typeRef));
+	return lean_io_result_mk_ok(lean_box(legal));
+}
+
+// Get the (power-of-two) lengths of the legal fixed vectors of the given
+// element type on the given target machine, in increasing order.
+extern "C" lean_obj_res papyrus_target_machine_get_legal_vector_lengths
+	(b_lean_obj_res elemTypeRef, b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	auto elemType = toType(elemTypeRef);
+	auto tti = toTMExternal(tmRef)->getTTI();
+	lean_object* arr = lean_alloc_array(0, PAPYRUS_DEFAULT_ARRAY_CAPCITY);
+	if (VectorType::isValidElementType(elemType)) {
+		// No target has vector registers wider than 2048 bits
+		for (unsigned n = 2; n <= 2048; n *= 2) {
+			if (tti.isTypeLegal(FixedVectorType::get(elemType, n))) {
+				arr = lean_array_push(arr, lean_box(n));
+			}
+		}
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+//------------------------------------------------------------------------------
+// Module targets
+//------------------------------------------------------------------------------
+
+// Get the data layout of the host.
+// The host's target machine is only created once.
+static Expected<std::string> getHostDataLayout() {
+	static std::mutex mutex;
+	static std::string layout;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (layout.empty()) {
+		auto tm = createHostTargetMachine(CodeGenOpt::Default);
+		if (!tm) return tm.takeError();
+		layout = (*tm)->createDataLayout().getStringRepresentation();
+		delete *tm;
+	}
+	return layout;
+}
+
+// Get the target triple of the given module.
+extern "C" lean_obj_res papyrus_module_get_target_triple
+	(b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(mkStringFromStd(toModule(modRef)->getTargetTriple()));
+}
+
+// Set the target triple of the given module
+// (to that of the host if the given triple is empty).
+extern "C" lean_obj_res papyrus_module_set_target_triple
+	(b_lean_obj_res modRef, b_lean_obj_res tripleObj, lean_obj_arg /* w */)
+{
+	auto triple = refOfString(tripleObj);
+	toModule(modRef)->setTargetTriple(triple.empty() ?
+		sys::getProcessTriple() : Triple::normalize(triple));
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Get the data layout string of the given module.
+extern "C" lean_obj_res papyrus_module_get_data_layout
+	(b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(mkStringFromStd(toModule(modRef)->getDataLayoutStr()));
+}
+
+// Set the data layout of the given module from its string representation
+// (or to that of the host if the given string is empty).
+// Setting the host's data layout requires the native target to be initialized.
+extern "C" lean_obj_res papyrus_module_set_data_layout
+	(b_lean_obj_res modRef, b_lean_obj_res layoutObj, lean_obj_arg /* w */)
+{
+	auto layoutStr = refOfString(layoutObj);
+	if (layoutStr.empty()) {
+		auto hostLayout = getHostDataLayout();
+		if (!hostLayout) return mkStdStringError(toString(hostLayout.takeError()));
+		toModule(modRef)->setDataLayout(*hostLayout);
+		return lean_io_result_mk_ok(lean_box(0));
+	}
+	auto layout = DataLayout::parse(layoutStr);
+	if (!layout) return mkStdStringError(toString(layout.takeError()));
+	toModule(modRef)->setDataLayout(*layout);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Set the target triple and data layout of the given module
+// to those of the given target machine.
+extern "C" lean_obj_res papyrus_module_set_target
+	(b_lean_obj_res modRef, b_lean_obj_res tmRef, lean_obj_arg /* w */)
+{
+	auto tm = toTargetMachine(tmRef);
+	auto mod = toModule(modRef);
+	mod->setTargetTriple(tm->getTargetTriple().str());
+	mod->setDataLayout(tm->createDataLayout());
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+//------------------------------------------------------------------------------
+// Data layout queries
+//------------------------------------------------------------------------------
+
+// Get the size and alignment of each of the given (sized) types
+// under the data layout of the given module.
+// Returns an array of `TypeLayout`s.
+extern "C" lean_obj_res papyrus_module_get_type_layouts
+	(b_lean_obj_res typesObj, b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+	auto& dl = toModule(modRef)->getDataLayout();
+	auto types = viewArray(typesObj);
+	lean_object* arr = lean_alloc_array(0, types.size());
+	for (auto typeRef : types) {
+		auto type = toType(typeRef);
+		if (!type->isSized()) {
+			lean_dec_ref(arr);
+			return mkStringError("Type has no size.");
+		}
+		lean_object* obj = lean_alloc_ctor(0, 0, 5*sizeof(uint64_t));
+		lean_ctor_set_uint64(obj, 0, dl.getTypeSizeInBits(type).getFixedSize());
+		lean_ctor_set_uint64(obj, sizeof(uint64_t), dl.getTypeStoreSize(type).getFixedSize());
+		lean_ctor_set_uint64(obj, 2*sizeof(uint64_t), dl.getTypeAllocSize(type).getFixedSize());
+		lean_ctor_set_uint64(obj, 3*sizeof(uint64_t), dl.getABITypeAlignment(type));
+		lean_ctor_set_uint64(obj, 4*sizeof(uint64_t), dl.getPrefTypeAlignment(type));
+		arr = lean_array_push(arr, obj);
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+// Get the size, alignment, and field offsets of each of the given
+// (non-opaque) struct types under the data layout of the given module.
+// Returns an array of `StructLayout`s.
+extern "C" lean_obj_res papyrus_module_get_struct_layouts
+	(b_lean_obj_res typesObj, b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+	auto& dl = toModule(modRef)->getDataLayout();
+	auto types = viewArray(typesObj);
+	lean_object* arr = lean_alloc_array(0, types.size());
+	for (auto typeRef : types) {
+		auto type = dyn_cast<StructType>(toType(typeRef));
+		if (!type || !type->isSized()) {
+			lean_dec_ref(arr);
+			return mkStringError("Type is not a sized struct type.");
+		}
+		// Struct layouts are cached by the data layout
+		auto layout = dl.getStructLayout(type);
+		auto numFields = type->getNumElements();
+		lean_object* offsets = lean_alloc_array(0, numFields);
+		for (unsigned i = 0; i < numFields; i++) {
+			offsets = lean_array_push(offsets, lean_uint64_to_nat(layout->getElementOffset(i)));
+		}
+		lean_object* obj = lean_alloc_ctor(0, 1, 2*sizeof(uint64_t));
+		lean_ctor_set(obj, 0, offsets);
+		lean_ctor_set_uint64(obj, sizeof(void*)*1, layout->getSizeInBytes());
+		lean_ctor_set_uint64(obj, sizeof(void*)*1 + sizeof(uint64_t), layout->getAlignment().value());
+		arr = lean_array_push(arr, obj);
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+} // end namespace papyrus
@@ -0,0 +1,603 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+
+#include <vector>
+#include <lean/lean.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SCCIterator.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/Analysis/InlineCost.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/DiagnosticPrinter.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/ProfileCommon.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/Internalize.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+using namespace llvm;
+
+namespace papyrus {
+
+//------------------------------------------------------------------------------
+// Optimization pipeline
+//------------------------------------------------------------------------------
+
+// Run LLVM's standard IR optimization pipeline over a module.
+// Without a target machine, target-independent costs are assumed.
+void optimizeModule(Module& mod, TargetMachine* tm, unsigned optLevel) {
+	PassManagerBuilder pmb;
+	pmb.OptLevel = optLevel;
+	pmb.Inliner = createFunctionInliningPass(optLevel, 0, false);
+	pmb.LoopVectorize = optLevel > 1;
+	pmb.SLPVectorize = optLevel > 1;
+	legacy::FunctionPassManager fpm(&mod);
+	legacy::PassManager mpm;
+	if (tm) {
+		tm->adjustPassManager(pmb);
+		fpm.add(createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+		mpm.add(createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+	}
+	pmb.populateFunctionPassManager(fpm);
+	pmb.populateModulePassManager(mpm);
+	fpm.doInitialization();
+	for (auto& fn : mod) fpm.run(fn);
+	fpm.doFinalization();
+	mpm.run(mod);
+}
+
+// Optimize the given module with LLVM's standard pipeline
+// at the given level (like `opt -O<level>`).
+extern "C" lean_obj_res papyrus_module_optimize
+	(b_lean_obj_res modRef, uint8_t optLevel, lean_obj_arg /* w */)
+{
+	optimizeModule(*toModule(modRef), nullptr, optLevel);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+//------------------------------------------------------------------------------
+// Linking
+//------------------------------------------------------------------------------
+
+// Collects the error diagnostics of a context (instead of letting LLVM
+// print them and exit) for as long as it lives.
+class DiagnosticCapture {
+public:
+	DiagnosticCapture(LLVMContext& ctx) : ctx(ctx), prev(ctx.getDiagnosticHandler()) {
+		ctx.setDiagnosticHandler(std::make_unique<Handler>(errors));
+	}
+	DiagnosticCapture(const DiagnosticCapture&) = delete;
+	~DiagnosticCapture() { ctx.setDiagnosticHandler(std::move(prev)); }
+
+	std::string errors;
+
+private:
+	struct Handler : public DiagnosticHandler {
+		std::string& errors;
+		Handler(std::string& errors) : errors(errors) {}
+		bool handleDiagnostics(const DiagnosticInfo& info) override {
+			if (info.getSeverity() == DS_Error) {
+				raw_string_ostream out(errors);
+				DiagnosticPrinterRawOStream printer(out);
+				info.print(printer);
+				out << "\n";
+			}
+			return true;
+		}
+	};
+
+	LLVMContext& ctx;
+	std::unique_ptr<DiagnosticHandler> prev;
+};
+
+// Link a copy of the source module into the destination module.
+// If lazy, only the definitions the destination references are linked.
+// The source module is left untouched so it can be linked again.
+extern "C" lean_obj_res papyrus_module_link
+	(b_lean_obj_res dstRef, b_lean_obj_res srcRef, uint8_t lazy, lean_obj_arg /* w */)
+{
+	auto dst = toModule(dstRef);
+	auto src = toModule(srcRef);
+	if (&dst->getContext() != &src->getContext()) {
+		return mkStringError("Cannot link modules of different contexts.");
+	}
+	if (dst == src) return mkStringError("Cannot link a module into itself.");
+	DiagnosticCapture diags(dst->getContext());
+	auto flags = lazy ? Linker::Flags::LinkOnlyNeeded : Linker::Flags::None;
+	if (Linker::linkModules(*dst, CloneModule(*src), flags)) {
+		return mkStdStringError(diags.errors.empty() ? "Linking failed." : diags.errors);
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Give every definition of the given module except the exported ones
+// internal linkage, then delete the globals that became unreachable.
+// Returns the number of globals deleted.
+extern "C" lean_obj_res papyrus_module_internalize
+	(b_lean_obj_res modRef, b_lean_obj_res exportsObj, lean_obj_arg /* w */)
+{
+	auto mod = toModule(modRef);
+	StringSet<> exports;
+	for (auto nameObj : viewArray(exportsObj)) exports.insert(refOfString(nameObj));
+	auto countGlobals = [mod] {
+		return mod->size() + mod->global_size() + mod->alias_size() + mod->ifunc_size();
+	};
+	auto numGlobals = countGlobals();
+	internalizeModule(*mod, [&exports](const GlobalValue& gv) {
+		return exports.count(gv.getName()) > 0;
+	});
+	legacy::PassManager pm;
+	pm.add(createGlobalDCEPass());
+	pm.run(*mod);
+	return lean_io_result_mk_ok(lean_box(numGlobals - countGlobals()));
+}
+
+//------------------------------------------------------------------------------
+// Cloning and specialization
+//------------------------------------------------------------------------------
+
+// Check that a function can be cloned (i.e., is a definition in a module).
+static const char* checkClonable(Function* fn) {
+	if (fn->isDeclaration()) return "Cannot clone a function declaration.";
+	if (!fn->getParent()) return "Cannot clone a function outside a module.";
+	return nullptr;
+}
+
+// Simplify a function locally: propagate constants, combine instructions,
+// and fold away the branches and blocks that became dead.
+static void simplifyFunction(Function& fn) {
+	legacy::FunctionPassManager fpm(fn.getParent());
+	fpm.add(createSCCPPass());
+	fpm.add(createInstructionCombiningPass());
+	fpm.add(createCFGSimplificationPass());
+	fpm.doInitialization();
+	fpm.run(fn);
+	fpm.doFinalization();
+}
+
+// Simplify the given function (see `simplifyFunction`).
+extern "C" lean_obj_res papyrus_function_simplify
+	(b_lean_obj_res funRef, lean_obj_arg /* w */)
+{
+	auto fn = toFunction(funRef);
+	if (fn->isDeclaration() || !fn->getParent()) {
+		return mkStringError("Can only simplify function definitions in a module.");
+	}
+	simplifyFunction(*fn);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Clone the given function into its module under the given name.
+extern "C" lean_obj_res papyrus_function_clone
+	(b_lean_obj_res funRef, b_lean_obj_res nameObj, lean_obj_arg /* w */)
+{
+	auto fn = toFunction(funRef);
+	if (auto err = checkClonable(fn)) return mkStringError(err);
+	ValueToValueMapTy vmap;
+	auto clone = CloneFunction(fn, vmap);
+	clone->setName(refOfString(nameObj));
+	return lean_io_result_mk_ok(mkValueRef(copyLink(funRef), clone));
+}
+
+// The kind of the metadata recording the key a specialization was made for.
+static const char* specializationKind = "papyrus.specialization";
+
+// Get the key the given function was specialized for (empty if none).
+static StringRef getSpecializationKey(const Function& fn) {
+	auto md = fn.getMetadata(specializationKind);
+	if (!md || md->getNumOperands() != 1) return "";
+	auto str = dyn_cast_or_null<MDString>(md->getOperand(0));
+	return str ? str->getString() : "";
+}
+
+// Specialize the given function for the given `Option` constants
+// of its leading arguments. The clone (added to the function's module) takes
+// only the remaining arguments and is optionally simplified.
+// It is named after a hash of the argument tuple and records the full tuple
+// in its metadata, so specializing the function again for the same constants
+// (and simplification) returns the existing clone.
+extern "C" lean_obj_res papyrus_function_specialize
+	(b_lean_obj_res funRef, b_lean_obj_res argsObj, uint8_t simplify, lean_obj_arg /* w */)
+{
+	auto fn = toFunction(funRef);
+	if (auto err = checkClonable(fn)) return mkStringError(err);
+	auto args = viewArray(argsObj);
+	if (args.size() > fn->arg_size()) {
+		return mkStringError("More constants than the function has arguments.");
+	}
+	ValueToValueMapTy vmap;
+	std::string key;
+	raw_string_ostream keyOut(key);
+	for (size_t i = 0; i < fn->arg_size(); i++) {
+		keyOut << ';';
+		if (i >= args.size() || lean_is_scalar(args[i])) continue;
+		auto arg = fn->getArg(i);
+		auto val = toConstant(lean_ctor_get(args[i], 0));
+		if (val->getType() != arg->getType()) {
+			return mkStdStringError("Constant does not match the type of argument " +
+				std::to_string(i) + ".");
+		}
+		val->print(keyOut);
+		vmap[arg] = val;
+	}
+	keyOut << (simplify ? ";simplified" : ";unsimplified");
+	keyOut.flush();
+	// Probe past functions whose name hashes the same but whose key differs
+	auto& ctx = fn->getContext();
+	auto baseName = (fn->getName() + ".spec." + utohexstr(xxHash64(key))).str();
+	auto name = baseName;
+	for (unsigned probe = 1;; probe++) {
+		auto spec = fn->getParent()->getFunction(name);
+		if (!spec) break;
+		if (getSpecializationKey(*spec) == key) {
+			return lean_io_result_mk_ok(mkValueRef(copyLink(funRef), spec));
+		}
+		name = baseName + "." + std::to_string(probe);
+	}
+	auto spec = CloneFunction(fn, vmap);
+	spec->setName(name);
+	spec->setMetadata(specializationKind,
+		MDNode::get(ctx, MDString::get(ctx, key)));
+	if (simplify) simplifyFunction(*spec);
+	return lean_io_result_mk_ok(mkValueRef(copyLink(funRef), spec));
+}
+
+//------------------------------------------------------------------------------
+// Inlining
+//------------------------------------------------------------------------------
+
+// The analyses LLVM's inline cost model needs, computed on demand.
+// Without a target machine, target-independent costs are assumed.
+class InlineAnalyses {
+public:
+	InlineAnalyses(Module& mod, TargetMachine* tm)
+		: tm(tm), tlii(Triple(mod.getTargetTriple())), tli(tlii) {}
+
+	// Estimate the cost of inlining the given (direct) call
+	// against the given threshold.
+	InlineCost getCost(CallBase& call, int threshold) {
+		auto& callee = *call.getCalledFunction();
+		auto tti = tm ? tm->getTargetTransformInfo(callee) :
+			TargetTransformInfo(callee.getParent()->getDataLayout());
+		return getInlineCost(call, getInlineParams(threshold), tti,
+			[&](Function& fn) -> AssumptionCache& { return getAssumptionCache(fn); },
+			[&](Function&) -> const TargetLibraryInfo& { return tli; });
+	}
+
+	// Inline the given call, keeping the caller's assumptions up to date.
+	InlineResult inlineCall(CallBase& call) {
+		auto getAC = [&](Function& fn) -> AssumptionCache& { return getAssumptionCache(fn); };
+		InlineFunctionInfo ifi(nullptr, getAC);
+		return InlineFunction(call, ifi);
+	}
+
+private:
+	AssumptionCache& getAssumptionCache(Function& fn) {
+		auto& ac = caches[&fn];
+		if (!ac) ac = std::make_unique<AssumptionCache>(fn);
+		return *ac;
+	}
+
+	TargetMachine* tm;
+	TargetLibraryInfoImpl tlii;
+	TargetLibraryInfo tli;
+	DenseMap<Function*, std::unique_ptr<AssumptionCache>> caches;
+};
+
+// Get the target machine of an `Option TargetMachineRef` (if any).
+static TargetMachine* toOptTargetMachine(b_lean_obj_arg tmObj) {
+	return lean_is_scalar(tmObj) ? nullptr : toTargetMachine(lean_ctor_get(tmObj, 0));
+}
+
+// Check that the given call can be inlined
+// (i.e., is a direct call to a definition in a module).
+static const char* checkInlinable(CallBase& call) {
+	if (!call.getParent() || !call.getFunction()->getParent())
+		return "Call is not in a function of a module.";
+	auto callee = call.getCalledFunction();
+	if (!callee) return "Cannot inline an indirect call.";
+	if (callee->isDeclaration()) return "Cannot inline a call to a function declaration.";
+	return nullptr;
+}
+
+// Inline the function called by the given call instruction into its caller.
+extern "C" lean_obj_res papyrus_call_inst_inline
+	(b_lean_obj_res callRef, lean_obj_arg /* w */)
+{
+	auto& call = *cast<CallBase>(toInstruction(callRef));
+	if (auto err = checkInlinable(call)) return mkStringError(err);
+	InlineAnalyses analyses(*call.getModule(), nullptr);
+	auto result = analyses.inlineCall(call);
+	if (!result.isSuccess()) {
+		return mkStdStringError(std::string("Could not inline call: ") +
+			result.getFailureReason());
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Estimate the cost of inlining the given call against the given threshold.
+// Returns a Lean `InlineCost`.
+extern "C" lean_obj_res papyrus_call_inst_get_inline_cost
+	(b_lean_obj_res callRef, uint32_t threshold, b_lean_obj_res tmObj,
+		lean_obj_arg /* w */)
+{
+	auto& call = *cast<CallBase>(toInstruction(callRef));
+	if (auto err = checkInlinable(call)) return mkStringError(err);
+	InlineAnalyses analyses(*call.getModule(), toOptTargetMachine(tmObj));
+	auto cost = analyses.getCost(call, threshold);
+	uint8_t kind = cost.isAlways() ? 0 : cost.isNever() ? 1 : 2;
+	auto reason = cost.getReason();
+	lean_object* obj = lean_alloc_ctor(0, 3, 1);
+	lean_ctor_set(obj, 0, lean_int64_to_int(cost.isVariable() ? cost.getCost() : 0));
+	lean_ctor_set(obj, 1, lean_int64_to_int(cost.isVariable() ? cost.getThreshold() : threshold));
+	lean_ctor_set(obj, 2, lean_mk_string(reason ? reason : ""));
+	lean_ctor_set_uint8(obj, sizeof(void*)*3, kind);
+	return lean_io_result_mk_ok(obj);
+}
+
+// Inline the calls of the given module whose estimated cost is below
+// the given threshold, visiting callees before their callers (so that
+// callers see the already inlined bodies of their callees).
+// Calls within a recursive cycle are not inlined.
+// If `removeDead`, internal functions left unused are deleted.
+// Returns the number of calls inlined.
+extern "C" lean_obj_res papyrus_module_inline
+	(b_lean_obj_res modRef, uint32_t threshold, b_lean_obj_res tmObj,
+		uint8_t removeDead, lean_obj_arg /* w */)
+{
+	auto& mod = *toModule(modRef);
+	InlineAnalyses analyses(mod, toOptTargetMachine(tmObj));
+	// Order the functions bottom-up before the inliner changes the call graph.
+	std::vector<std::vector<Function*>> sccs;
+	{
+		CallGraph cg(mod);
+		for (auto it = scc_begin(&cg); !it.isAtEnd(); ++it) {
+			std::vector<Function*> scc;
+			for (auto node : *it) {
+				auto fn = node->getFunction();
+				if (fn && !fn->isDeclaration()) scc.push_back(fn);
+			}
+			if (!scc.empty()) sccs.push_back(std::move(scc));
+		}
+	}
+	size_t numInlined = 0;
+	for (auto& scc : sccs) {
+		SmallPtrSet<Function*, 4> cycle(scc.begin(), scc.end());
+		for (auto fn : scc) {
+			SmallVector<CallBase*, 16> calls;
+			for (auto& bb : *fn) for (auto& inst : bb) {
+				auto call = dyn_cast<CallBase>(&inst);
+				if (!call) continue;
+				auto callee = call->getCalledFunction();
+				if (callee && !callee->isDeclaration() && !cycle.count(callee))
+					calls.push_back(call);
+			}
+			for (auto call : calls) {
+				if (!analyses.getCost(*call, threshold)) continue;
+				if (analyses.inlineCall(*call).isSuccess()) numInlined++;
+			}
+		}
+	}
+	// Delete callers first, so that their callees may become unused too.
+	if (removeDead) for (auto scc = sccs.rbegin(); scc != sccs.rend(); ++scc) {
+		for (auto fn : *scc) {
+			if (fn->hasLocalLinkage() && fn->use_empty()) fn->eraseFromParent();
+		}
+	}
+	return lean_io_result_mk_ok(lean_usize_to_nat(numInlined));
+}
+
+//------------------------------------------------------------------------------
+// Profile-guided optimization
+//------------------------------------------------------------------------------
+
+// The counters of a profiled function.
+// Each basic block has a counter, followed by a pair of counters
+// (taken and not taken) for each conditional branch (in block order).
+struct ProfiledFunction {
+	std::string name;
+	size_t numBlocks;
+	size_t firstCounter;
+	size_t numCounters;
+};
+
+// An in-memory block and branch profile of a module.
+struct Profile {
+	// The name of the counter array in the instrumented module.
+	std::string counterName;
+	std::vector<ProfiledFunction> fns;
+	// The counts collected so far.
+	std::vector<uint64_t> counts;
+};
+
+// The conditional branch terminating the given block (if any).
+static BranchInst* getCondBranch(BasicBlock& bb) {
+	auto br = dyn_cast_or_null<BranchInst>(bb.getTerminator());
+	return br && br->isConditional() ? br : nullptr;
+}
+
+// The number of counters a function needs.
+static size_t countCounters(Function& fn) {
+	size_t n = fn.size();
+	for (auto& bb : fn) {
+		if (getCondBranch(bb)) n += 2;
+	}
+	return n;
+}
+
+// Emit an increment of the counter at the given index.
+static void emitIncrement(IRBuilder<>& b, GlobalVariable* counters, Value* idx) {
+	auto ptr = b.CreateInBoundsGEP(counters->getValueType(), counters, {b.getInt64(0), idx});
+	auto val = b.CreateLoad(b.getInt64Ty(), ptr);
+	b.CreateStore(b.CreateAdd(val, b.getInt64(1)), ptr);
+}
+
+// Instrument the definitions of a module with counters for the given profile.
+static void instrumentModule(Module& mod, Profile& prof) {
+	for (auto& fn : mod) {
+		if (fn.isDeclaration()) continue;
+		auto numCounters = countCounters(fn);
+		prof.fns.push_back({fn.getName().str(), fn.size(), prof.counts.size(), numCounters});
+		prof.counts.resize(prof.counts.size() + numCounters);
+	}
+	auto arrTy = ArrayType::get(Type::getInt64Ty(mod.getContext()), prof.counts.size());
+	auto counters = new GlobalVariable(mod, arrTy, false,
+		GlobalValue::ExternalLinkage, ConstantAggregateZero::get(arrTy), prof.counterName);
+	for (auto& pf : prof.fns) {
+		auto fn = mod.getFunction(pf.name);
+		auto blockCounter = pf.firstCounter;
+		auto branchCounter = pf.firstCounter + pf.numBlocks;
+		for (auto& bb : *fn) {
+			auto br = getCondBranch(bb);
+			auto pt = bb.getFirstInsertionPt();
+			// Blocks without an insertion point (e.g., `catchswitch`) stay uncounted
+			if (pt != bb.end()) {
+				IRBuilder<> b(&bb, pt);
+				emitIncrement(b, counters, b.getInt64(blockCounter));
+			}
+			blockCounter++;
+			if (br) {
+				IRBuilder<> b(br);
+				auto idx = b.CreateSelect(br->getCondition(),
+					b.getInt64(branchCounter), b.getInt64(branchCounter + 1));
+				emitIncrement(b, counters, idx);
+				branchCounter += 2;
+			}
+		}
+	}
+}
+
+// Scale 64-bit counts down to 32-bit branch weights.
+static SmallVector<uint32_t, 4> scaleWeights(ArrayRef<uint64_t> counts) {
+	uint64_t max = 0;
+	for (auto count : counts) max = std::max(max, count);
+	uint64_t scale = max / UINT32_MAX + 1;
+	SmallVector<uint32_t, 4> weights;
+	for (auto count : counts) weights.push_back(count / scale);
+	return weights;
+}
+
+// Annotate a function with the given counts.
+// Switch weights are estimated from the counts of their successors.
+static void annotateFunction(Function& fn, const ProfiledFunction& pf,
+	ArrayRef<uint64_t> counts, InstrProfSummaryBuilder& summary)
+{
+	summary.addRecord(InstrProfRecord(std::vector<uint64_t>(
+		counts.begin(), counts.begin() + pf.numBlocks)));
+	fn.setEntryCount(Function::ProfileCount(counts[0], Function::PCT_Real));
+	DenseMap<const BasicBlock*, uint64_t> blockCounts;
+	size_t i = 0;
+	for (auto& bb : fn) blockCounts[&bb] = counts[i++];
+	MDBuilder mdb(fn.getContext());
+	auto branchCounter = pf.numBlocks;
+	for (auto& bb : fn) {
+		SmallVector<uint64_t, 4> edgeCounts;
+		if (getCondBranch(bb)) {
+			edgeCounts.push_back(counts[branchCounter]);
+			edgeCounts.push_back(counts[branchCounter + 1]);
+			branchCounter += 2;
+		} else if (auto sw = dyn_cast_or_null<SwitchInst>(bb.getTerminator())) {
+			for (auto succ : successors(sw)) edgeCounts.push_back(blockCounts.lookup(succ));
+		} else {
+			continue;
+		}
+		if (llvm::all_of(edgeCounts, [](uint64_t c) { return c == 0; })) continue;
+		bb.getTerminator()->setMetadata(LLVMContext::MD_prof,
+			mdb.createBranchWeights(scaleWeights(edgeCounts)));
+	}
+}
+
+// Create an instrumented copy of the given module, whose block and branch
+// counts are recorded in the returned profile when collected.
+// Returns a pair of the instrumented module and the profile.
+extern "C" lean_obj_res papyrus_profile_instrument
+	(b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+	auto prof = new Profile();
+	// Name the counters uniquely so that profiles can share an engine
+	prof->counterName = "__papyrus_profile_" + utohexstr(reinterpret_cast<uintptr_t>(prof));
+	auto mod = CloneModule(*toModule(modRef));
+	instrumentModule(*mod, *prof);
+	counters.modulesCreated.fetch_add(1, std::memory_order_relaxed);
+	lean_object* pair = lean_alloc_ctor(0, 2, 0);
+	lean_ctor_set(pair, 0, mkModuleRef(copyLink(modRef), mod.release()));
+	lean_ctor_set(pair, 1, mkOwnedPtr<Profile>(prof));
+	return lean_io_result_mk_ok(pair);
+}
+
+// Add the counts recorded by the instrumented module in the given engine
+// to the profile and reset them.
+extern "C" lean_obj_res papyrus_profile_collect
+	(b_lean_obj_res profObj, b_lean_obj_res eeRef, lean_obj_arg /* w */)
+{
+	auto prof = fromOwnedPtr<Profile>(profObj);
+	auto ee = toExecutionEngine(eeRef);
+	// MCJIT engines look up symbols, while interpreters map globals
+	auto addr = ee->getGlobalValueAddress(prof->counterName);
+	if (!addr) addr = ee->getAddressToGlobalIfAvailable(prof->counterName);
+	if (!addr) {
+		return mkStringError("Execution engine does not contain the profiled module.");
+	}
+	auto counts = reinterpret_cast<uint64_t*>(addr);
+	for (size_t i = 0; i < prof->counts.size(); i++) {
+		prof->counts[i] += counts[i];
+		counts[i] = 0;
+	}
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Annotate the given (uninstrumented) module with the profile:
+// function entry counts, branch weights, and a profile summary.
+// Functions whose shape changed since instrumentation are skipped.
+// Returns the number of functions annotated.
+extern "C" lean_obj_res papyrus_profile_apply
+	(b_lean_obj_res profObj, b_lean_obj_res modRef, lean_obj_arg /* w */)
+{
+	auto prof = fromOwnedPtr<Profile>(profObj);
+	auto mod = toModule(modRef);
+	InstrProfSummaryBuilder summary(ProfileSummaryBuilder::DefaultCutoffs);
+	size_t numAnnotated = 0;
+	for (auto& pf : prof->fns) {
+		auto fn = mod->getFunction(pf.name);
+		if (!fn || fn->isDeclaration() || fn->size() != pf.numBlocks ||
+			countCounters(*fn) != pf.numCounters) continue;
+		auto counts = ArrayRef<uint64_t>(prof->counts).slice(pf.firstCounter, pf.numCounters);
+		annotateFunction(*fn, pf, counts, summary);
+		numAnnotated++;
+	}
+	mod->setProfileSummary(summary.getSummary()->getMD(mod->getContext()),
+		ProfileSummary::PSK_Instr);
+	return lean_io_result_mk_ok(lean_box(numAnnotated));
+}
+
+// Get the count of the entry block of the named function in the profile.
+extern "C" lean_obj_res papyrus_profile_get_entry_count
+	(b_lean_obj_res profObj, b_lean_obj_res nameObj, lean_obj_arg /* w */)
+{
+	auto prof = fromOwnedPtr<Profile>(profObj);
+	auto name = refOfString(nameObj);
+	for (auto& pf : prof->fns) {
+		if (pf.name == name) {
+			return lean_io_result_mk_ok(lean_box_uint64(prof->counts[pf.firstCounter]));
+		}
+	}
+	return mkStringError("Function is not in the profile.");
+}
+
+} // end namespace papyrus
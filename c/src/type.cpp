@@ -1,11 +1,19 @@
 #include "papyrus.h"
 #include "papyrus_ffi.h"
+#include "papyrus_ostream.h"
 
+#include <memory>
+#include <mutex>
 #include <lean/lean.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/Support/TypeSize.h>
 #include <llvm/ADT/APFloat.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Endian.h>
 
 using namespace llvm;
 
@@ -39,9 +47,11 @@ lean_obj_res packTypes
 	return obj;
 }
 
-// Covert a Lean Array of type references to an LLVM ArrayRef of types.
-// Defined as a macro because it needs to dynamically allocate to the user's stack.
-#define PAPYRUS_UNPACK_TYPES(OBJ, REF) LEAN_ARRAY_TO_REF(llvm::Type*, toType, OBJ, REF)
+// Covert a Lean Array of type references to an LLVM vector of types.
+static inline SmallVector<llvm::Type*, PAPYRUS_INLINE_ARRAY_SIZE>
+unpackTypes(b_lean_obj_arg arr) {
+	return unpackArray<llvm::Type*>(arr, toType);
+}
 
 //------------------------------------------------------------------------------
 // Basic functions
@@ -82,10 +92,9 @@ extern "C" lean_obj_res papyrus_type_eprint
 extern "C" lean_obj_res papyrus_type_sprint
 	(b_lean_obj_res typeRef, uint8_t isForDebug, lean_obj_arg /* w */)
 {
-	std::string ostr;
-	raw_string_ostream out(ostr);
+	LeanStringOstream out;
 	toType(typeRef)->print(out, isForDebug);
-	return lean_io_result_mk_ok(mkStringFromStd(out.str()));
+	return lean_io_result_mk_ok(out.take());
 }
 
 //------------------------------------------------------------------------------
@@ -239,7 +248,7 @@ extern "C" lean_obj_res papyrus_get_function_type
 	(b_lean_obj_res resultObj, b_lean_obj_res paramsObj, uint8_t isVarArg,
 		lean_obj_arg /* w */)
 {
-	PAPYRUS_UNPACK_TYPES(paramsObj, params);
+	auto params = unpackTypes(paramsObj);
 	auto type = FunctionType::get(toType(resultObj), params, isVarArg);
 	return lean_io_result_mk_ok(mkTypeRef(copyLink(resultObj), type));
 }
@@ -324,7 +333,7 @@ extern "C" lean_obj_res papyrus_get_literal_struct_type
 	(b_lean_obj_res elemsObj, uint8_t isPacked, lean_obj_arg ctxRef,
 		lean_obj_arg /* w */)
 {
-	PAPYRUS_UNPACK_TYPES(elemsObj, elems);
+	auto elems = unpackTypes(elemsObj);
 	auto type = StructType::get(*toLLVMContext(ctxRef), elems, isPacked);
 	return lean_io_result_mk_ok(mkTypeRef(ctxRef, type));
 }
@@ -344,7 +353,7 @@ extern "C" lean_obj_res papyrus_struct_type_create
 	(b_lean_obj_res nameObj, b_lean_obj_res elemsObj, uint8_t isPacked,
 		lean_obj_arg ctxRef, lean_obj_arg /* w */)
 {
-	PAPYRUS_UNPACK_TYPES(elemsObj, elems);
+	auto elems = unpackTypes(elemsObj);
 	auto type = StructType::create(*toLLVMContext(ctxRef),
 		elems, refOfString(nameObj), isPacked);
 	return lean_io_result_mk_ok(mkTypeRef(ctxRef, type));
@@ -403,7 +412,7 @@ extern "C" lean_obj_res papyrus_opaque_struct_type_set_body
 	(b_lean_obj_res elemsObj, uint8_t isPacked, b_lean_obj_res typeRef,
 		lean_obj_arg /* w */)
 {
-	PAPYRUS_UNPACK_TYPES(elemsObj, elems);
+	auto elems = unpackTypes(elemsObj);
 	toStructType(typeRef)->setBody(elems, isPacked);
 	return lean_io_result_mk_ok(lean_box(0));
 }
@@ -483,4 +492,259 @@ extern "C" lean_obj_res papyrus_vector_type_get_element_quantity
 	return lean_io_result_mk_ok(lean_box_uint32(q));
 }
 
+//------------------------------------------------------------------------------
+// Type lowering
+//------------------------------------------------------------------------------
+
+// Decodes types from the compact binary encoding of pure Lean types
+// produced by `Papyrus.Type.encode` and lowers them to LLVM types.
+//
+// Each type starts with its TypeID as a byte, followed by (little-endian):
+// * integer: the bit width (u32)
+// * function: the vararg flag (u8), parameter count (u32),
+//   and the return and parameter types
+// * pointer: the address space (u32) and the pointee type
+// * struct: a kind byte (0 = literal, 1 = complete, 2 = opaque), followed by
+//   the name length (u32) and UTF-8 bytes for identified structs, and then,
+//   for non-opaque structs, the packed flag (u8), element count (u32),
+//   and element types
+// * array: the size (u64) and the element type
+// * fixed/scalable vector: the (minimum) size (u32) and the element type
+class TypeDecoder {
+public:
+	TypeDecoder(LLVMContext& ctx, const uint8_t* data, size_t size)
+		: ctx(ctx), pos(data), end(data + size) {}
+
+	bool atEnd() const { return pos == end; }
+	const uint8_t* position() const { return pos; }
+	void seek(const uint8_t* newPos) { pos = newPos; }
+
+	// Skip over the next type, returning whether it mentions
+	// any identified structs (or nullopt if the encoding is malformed).
+	Optional<bool> skip() {
+		uint8_t tag;
+		if (!read(tag)) return None;
+		switch (tag) {
+		case Type::IntegerTyID:
+			return advance(4) ? Optional<bool>(false) : None;
+		case Type::FunctionTyID: {
+			uint32_t numParams;
+			if (!advance(1) || !read(numParams)) return None;
+			return skipMany(numParams + 1);
+		}
+		case Type::PointerTyID:
+			return advance(4) ? skip() : None;
+		case Type::StructTyID: {
+			uint8_t kind; uint32_t len;
+			if (!read(kind) || kind > 2) return None;
+			if (kind != 0) {
+				if (!read(len) || !advance(len)) return None;
+				if (kind == 2) return true;
+			}
+			uint32_t numElems;
+			if (!advance(1) || !read(numElems)) return None;
+			auto elems = skipMany(numElems);
+			if (!elems) return None;
+			return *elems || kind != 0;
+		}
+		case Type::ArrayTyID:
+			return advance(8) ? skip() : None;
+		case Type::FixedVectorTyID:
+		case Type::ScalableVectorTyID:
+			return advance(4) ? skip() : None;
+		default:
+			if (tag > Type::TokenTyID) return None;
+			return false;
+		}
+	}
+
+	// Decode and lower the next type (or return null if the encoding is malformed).
+	Type* decode() {
+		uint8_t tag;
+		if (!read(tag)) return nullptr;
+		switch (tag) {
+		case Type::HalfTyID: return Type::getHalfTy(ctx);
+		case Type::BFloatTyID: return Type::getBFloatTy(ctx);
+		case Type::FloatTyID: return Type::getFloatTy(ctx);
+		case Type::DoubleTyID: return Type::getDoubleTy(ctx);
+		case Type::X86_FP80TyID: return Type::getX86_FP80Ty(ctx);
+		case Type::FP128TyID: return Type::getFP128Ty(ctx);
+		case Type::PPC_FP128TyID: return Type::getPPC_FP128Ty(ctx);
+		case Type::VoidTyID: return Type::getVoidTy(ctx);
+		case Type::LabelTyID: return Type::getLabelTy(ctx);
+		case Type::MetadataTyID: return Type::getMetadataTy(ctx);
+		case Type::X86_MMXTyID: return Type::getX86_MMXTy(ctx);
+		case Type::X86_AMXTyID: return Type::getX86_AMXTy(ctx);
+		case Type::TokenTyID: return Type::getTokenTy(ctx);
+		case Type::IntegerTyID: {
+			uint32_t bitWidth;
+			if (!read(bitWidth)) return nullptr;
+			return IntegerType::get(ctx, bitWidth);
+		}
+		case Type::FunctionTyID: {
+			uint8_t isVarArg; uint32_t numParams;
+			if (!read(isVarArg) || !read(numParams)) return nullptr;
+			auto retType = decode();
+			SmallVector<Type*, 8> params;
+			if (!retType || !decodeMany(numParams, params)) return nullptr;
+			return FunctionType::get(retType, params, isVarArg);
+		}
+		case Type::PointerTyID: {
+			uint32_t addrSpace;
+			if (!read(addrSpace)) return nullptr;
+			auto pointee = decode();
+			return pointee ? PointerType::get(pointee, addrSpace) : nullptr;
+		}
+		case Type::StructTyID:
+			return decodeStruct();
+		case Type::ArrayTyID: {
+			uint64_t size;
+			if (!read(size)) return nullptr;
+			auto elem = decode();
+			return elem ? ArrayType::get(elem, size) : nullptr;
+		}
+		case Type::FixedVectorTyID: {
+			uint32_t size;
+			if (!read(size)) return nullptr;
+			auto elem = decode();
+			return elem ? FixedVectorType::get(elem, size) : nullptr;
+		}
+		case Type::ScalableVectorTyID: {
+			uint32_t minSize;
+			if (!read(minSize)) return nullptr;
+			auto elem = decode();
+			return elem ? ScalableVectorType::get(elem, minSize) : nullptr;
+		}
+		default:
+			return nullptr;
+		}
+	}
+
+private:
+	template<typename T> bool read(T& val) {
+		if (static_cast<size_t>(end - pos) < sizeof(T)) return false;
+		val = support::endian::read<T, support::little, 1>(pos);
+		pos += sizeof(T);
+		return true;
+	}
+
+	bool advance(size_t n) {
+		if (static_cast<size_t>(end - pos) < n) return false;
+		pos += n;
+		return true;
+	}
+
+	Optional<bool> skipMany(uint64_t n) {
+		bool identified = false;
+		for (uint64_t i = 0; i < n; i++) {
+			auto elem = skip();
+			if (!elem) return None;
+			identified |= *elem;
+		}
+		return identified;
+	}
+
+	bool decodeMany(uint32_t n, SmallVectorImpl<Type*>& out) {
+		for (uint32_t i = 0; i < n; i++) {
+			auto type = decode();
+			if (!type) return false;
+			out.push_back(type);
+		}
+		return true;
+	}
+
+	// Lower a struct like `IdentifiedStructTypeRef.getOrCreate`
+	// (i.e., an existing identified struct's body is not checked).
+	Type* decodeStruct() {
+		uint8_t kind;
+		if (!read(kind)) return nullptr;
+		StringRef name;
+		if (kind != 0) {
+			uint32_t len;
+			if (!read(len) || static_cast<size_t>(end - pos) < len) return nullptr;
+			name = StringRef(reinterpret_cast<const char*>(pos), len);
+			pos += len;
+			if (kind == 2) {
+				if (auto type = StructType::getTypeByName(ctx, name)) return type;
+				return StructType::create(ctx, name);
+			}
+		}
+		uint8_t isPacked; uint32_t numElems;
+		if (!read(isPacked) || !read(numElems)) return nullptr;
+		SmallVector<Type*, 8> elems;
+		if (!decodeMany(numElems, elems)) return nullptr;
+		if (kind == 0) return StructType::get(ctx, elems, isPacked);
+		if (auto type = StructType::getTypeByName(ctx, name)) return type;
+		return StructType::create(ctx, elems, name, isPacked);
+	}
+
+	LLVMContext& ctx;
+	const uint8_t* pos;
+	const uint8_t* end;
+};
+
+// The types each context has lowered, keyed by their encoding.
+// Types mentioning identified structs are not memoized,
+// as the struct may have been renamed since.
+static std::mutex loweredTypesMutex;
+static DenseMap<LLVMContext*, std::unique_ptr<StringMap<Type*>>> loweredTypes;
+
+// Drop the lowered types memoized for a context (e.g., when it is deleted).
+void forgetLoweredTypes(LLVMContext* ctx) {
+	std::lock_guard<std::mutex> lock(loweredTypesMutex);
+	loweredTypes.erase(ctx);
+}
+
+// Get the table of lowered types memoized for a context.
+static StringMap<Type*>& getLoweredTypes(LLVMContext* ctx) {
+	std::lock_guard<std::mutex> lock(loweredTypesMutex);
+	auto& memo = loweredTypes[ctx];
+	if (!memo) memo = std::make_unique<StringMap<Type*>>();
+	return *memo;
+}
+
+// Lower an array of the given number of encoded types
+// to an array of references to LLVM types (in one call).
+extern "C" lean_obj_res papyrus_type_lower_encoded
+	(b_lean_obj_res bytesObj, uint32_t numTypes, lean_obj_arg ctxRef,
+		lean_obj_arg /* w */)
+{
+	auto ctx = toLLVMContext(ctxRef);
+	auto& memo = getLoweredTypes(ctx);
+	auto bytes = lean_to_sarray(bytesObj);
+	TypeDecoder decoder(*ctx, bytes->m_data, bytes->m_size);
+	SmallVector<Type*, 8> types;
+	types.reserve(numTypes);
+	for (uint32_t i = 0; i < numTypes; i++) {
+		auto start = decoder.position();
+		TypeDecoder skipper = decoder;
+		auto identified = skipper.skip();
+		if (!identified) {
+			lean_dec_ref(ctxRef);
+			return mkStringError("Malformed type encoding.");
+		}
+		auto key = StringRef(reinterpret_cast<const char*>(start),
+			skipper.position() - start);
+		if (!*identified) {
+			auto it = memo.find(key);
+			if (it != memo.end()) {
+				types.push_back(it->second);
+				decoder.seek(skipper.position());
+				continue;
+			}
+		}
+		auto type = decoder.decode();
+		assert(type && decoder.position() == skipper.position());
+		if (!*identified) memo[key] = type;
+		types.push_back(type);
+	}
+	if (!decoder.atEnd()) {
+		lean_dec_ref(ctxRef);
+		return mkStringError("Malformed type encoding.");
+	}
+	lean_object* arr = packTypes(ctxRef, types);
+	lean_dec_ref(ctxRef);
+	return lean_io_result_mk_ok(arr);
+}
+
 } // end namespace papyrus
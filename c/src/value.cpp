@@ -1,7 +1,11 @@
 #include "papyrus.h"
 #include "papyrus_ffi.h"
+#include "papyrus_ostream.h"
 
 #include <lean/lean.h>
+#include <llvm/IR/Constant.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/User.h>
 #include <llvm/IR/Value.h>
 #include <llvm/ADT/Twine.h>
 #include <llvm/Support/raw_ostream.h>
@@ -89,10 +93,100 @@ extern "C" lean_obj_res papyrus_value_eprint
 extern "C" lean_obj_res papyrus_value_sprint
 	(b_lean_obj_res valueRef, uint8_t isForDebug, lean_obj_arg /* w */)
 {
-	std::string ostr;
-	raw_string_ostream out(ostr);
+	LeanStringOstream out;
 	toValue(valueRef)->print(out, isForDebug);
-	return lean_io_result_mk_ok(mkStringFromStd(out.str()));
+	return lean_io_result_mk_ok(out.take());
+}
+
+//------------------------------------------------------------------------------
+// Uses
+//------------------------------------------------------------------------------
+
+// Get the number of uses of the given value.
+extern "C" lean_obj_res papyrus_value_get_num_uses
+	(b_lean_obj_res valueRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(lean_box(toValue(valueRef)->getNumUses()));
+}
+
+// Get an array of references to the users of the given value
+// (with a user repeated for each of its uses of the value).
+extern "C" lean_obj_res papyrus_value_get_users
+	(b_lean_obj_res valueRef, lean_obj_arg /* w */)
+{
+	auto link = borrowLink(valueRef);
+	lean_object* arr = lean_alloc_array(0, PAPYRUS_DEFAULT_ARRAY_CAPCITY);
+	for (User* user : toValue(valueRef)->users()) {
+		lean_inc_ref(link);
+		arr = lean_array_push(arr, mkValueRef(link, user));
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+// Replace every use of the given value with the new value (of the same type).
+extern "C" lean_obj_res papyrus_value_replace_all_uses_with
+	(b_lean_obj_res valueRef, b_lean_obj_res newRef, lean_obj_arg /* w */)
+{
+	auto val = toValue(valueRef);
+	auto newVal = toValue(newRef);
+	if (val == newVal) return mkStringError("Cannot replace a value with itself.");
+	if (isa<Constant>(val) && !isa<GlobalValue>(val)) {
+		return mkStringError("Cannot replace the uses of a constant.");
+	}
+	if (val->getType() != newVal->getType()) {
+		return mkStringError("Replacement value has a different type.");
+	}
+	val->replaceAllUsesWith(newVal);
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+//------------------------------------------------------------------------------
+// Operands
+//------------------------------------------------------------------------------
+
+// Get the number of operands of the given user.
+extern "C" lean_obj_res papyrus_user_get_num_operands
+	(b_lean_obj_res userRef, lean_obj_arg /* w */)
+{
+	return lean_io_result_mk_ok(lean_box(cast<User>(toValue(userRef))->getNumOperands()));
+}
+
+// Get an array of references to the operands of the given user.
+extern "C" lean_obj_res papyrus_user_get_operands
+	(b_lean_obj_res userRef, lean_obj_arg /* w */)
+{
+	auto link = borrowLink(userRef);
+	auto user = cast<User>(toValue(userRef));
+	lean_object* arr = lean_alloc_array(0, user->getNumOperands());
+	for (Value* op : user->operand_values()) {
+		lean_inc_ref(link);
+		arr = lean_array_push(arr, mkValueRef(link, op));
+	}
+	return lean_io_result_mk_ok(arr);
+}
+
+// Get the nth operand of the given user.
+extern "C" lean_obj_res papyrus_user_get_operand
+	(uint32_t i, b_lean_obj_res userRef, lean_obj_arg /* w */)
+{
+	auto user = cast<User>(toValue(userRef));
+	if (i >= user->getNumOperands()) return mkStringError("Operand index out of range.");
+	return lean_io_result_mk_ok(mkValueRef(copyLink(userRef), user->getOperand(i)));
+}
+
+// Set the nth operand of the given user (which must not be a constant).
+extern "C" lean_obj_res papyrus_user_set_operand
+	(uint32_t i, b_lean_obj_res valueRef, b_lean_obj_res userRef, lean_obj_arg /* w */)
+{
+	auto user = cast<User>(toValue(userRef));
+	auto val = toValue(valueRef);
+	if (isa<Constant>(user)) return mkStringError("Cannot mutate the operands of a constant.");
+	if (i >= user->getNumOperands()) return mkStringError("Operand index out of range.");
+	if (user->getOperand(i) && user->getOperand(i)->getType() != val->getType()) {
+		return mkStringError("New operand has a different type.");
+	}
+	user->setOperand(i, val);
+	return lean_io_result_mk_ok(lean_box(0));
 }
 
 } // end namespace papyrus
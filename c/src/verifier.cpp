@@ -0,0 +1,154 @@
+#include "papyrus.h"
+#include "papyrus_ffi.h"
+
+#include <vector>
+#include <lean/lean.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+namespace papyrus {
+
+//------------------------------------------------------------------------------
+// Function fingerprints
+//------------------------------------------------------------------------------
+
+// Compute a fingerprint of the parts of a function the verifier checks:
+// its signature, attributes, and the opcode, type, flags, operands,
+// metadata attachments, and (for PHIs) incoming blocks of each instruction.
+// Far cheaper to compute than verifying the function.
+static uint64_t fingerprintFunction(const Function& fn) {
+	hash_code hash = hash_combine(fn.getFunctionType(),
+		fn.getAttributes().getRawPointer(), fn.getCallingConv(),
+		fn.getLinkage(), fn.hasPersonalityFn() ? fn.getPersonalityFn() : nullptr);
+	SmallVector<std::pair<unsigned, MDNode*>, 4> mds;
+	for (auto& bb : fn) {
+		hash = hash_combine(hash, &bb);
+		for (auto& inst : bb) {
+			hash = hash_combine(hash, &inst, inst.getOpcode(), inst.getType(),
+				inst.getRawSubclassOptionalData());
+			if (auto cmp = dyn_cast<CmpInst>(&inst)) {
+				hash = hash_combine(hash, cmp->getPredicate());
+			} else if (auto call = dyn_cast<CallBase>(&inst)) {
+				hash = hash_combine(hash, call->getAttributes().getRawPointer(),
+					call->getCallingConv());
+			}
+			for (auto& op : inst.operands()) {
+				hash = hash_combine(hash, op.get(), op->getType());
+			}
+			// Incoming blocks are not operands of a PHI
+			if (auto phi = dyn_cast<PHINode>(&inst)) {
+				for (auto block : phi->blocks()) hash = hash_combine(hash, block);
+			}
+			mds.clear();
+			inst.getAllMetadata(mds);
+			for (auto& md : mds) {
+				hash = hash_combine(hash, md.first, md.second);
+			}
+		}
+	}
+	return hash;
+}
+
+//------------------------------------------------------------------------------
+// Verifier caches
+//------------------------------------------------------------------------------
+
+// The fingerprints of the functions that last verified successfully.
+struct VerifierCache {
+	DenseMap<const Function*, uint64_t> verified;
+};
+
+// Create a new, empty verifier cache.
+extern "C" lean_obj_res papyrus_verifier_cache_new(lean_obj_arg /* w */) {
+	return lean_io_result_mk_ok(mkOwnedPtr<VerifierCache>(new VerifierCache()));
+}
+
+// Forget that the given function was verified,
+// forcing it to be re-verified by the next incremental check.
+extern "C" lean_obj_res papyrus_verifier_cache_invalidate
+	(b_lean_obj_res cacheObj, b_lean_obj_res funRef, lean_obj_arg /* w */)
+{
+	fromOwnedPtr<VerifierCache>(cacheObj)->verified.erase(toFunction(funRef));
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+// Forget all verified functions.
+extern "C" lean_obj_res papyrus_verifier_cache_clear
+	(b_lean_obj_res cacheObj, lean_obj_arg /* w */)
+{
+	fromOwnedPtr<VerifierCache>(cacheObj)->verified.clear();
+	return lean_io_result_mk_ok(lean_box(0));
+}
+
+//------------------------------------------------------------------------------
+// Incremental verification
+//------------------------------------------------------------------------------
+
+// Verify the function definitions of the given module whose fingerprint
+// differs from the one cached when they last verified successfully,
+// recording those that verify successfully.
+// Fingerprints only read the IR, so they are computed in parallel on a pool
+// of the given number of threads (or the number of hardware threads if zero).
+// LLVM does not guarantee that the verifier is thread safe within a context
+// (e.g., it may create types in it), so the changed functions are verified
+// serially. Reports the errors of all broken functions (in module order)
+// or returns the number of functions that were verified.
+static lean_obj_res verifyIncremental
+	(Module& mod, VerifierCache& cache, uint32_t numThreads)
+{
+	PhaseScope phase(Phase::Verify, mod.getModuleIdentifier());
+	std::vector<Function*> fns;
+	for (auto& fn : mod) {
+		if (!fn.isDeclaration()) fns.push_back(&fn);
+	}
+	std::vector<uint64_t> prints(fns.size());
+	{
+		ThreadPool pool(hardware_concurrency(numThreads));
+		for (size_t i = 0; i < fns.size(); i++) {
+			pool.async([&, i] { prints[i] = fingerprintFunction(*fns[i]); });
+		}
+		pool.wait();
+	}
+	size_t numChecked = 0;
+	std::string allErrors;
+	raw_string_ostream out(allErrors);
+	for (size_t i = 0; i < fns.size(); i++) {
+		auto it = cache.verified.find(fns[i]);
+		if (it != cache.verified.end() && it->second == prints[i]) continue;
+		numChecked++;
+		if (verifyFunction(*fns[i], &out)) {
+			cache.verified.erase(fns[i]);
+		} else {
+			cache.verified[fns[i]] = prints[i];
+		}
+	}
+	out.flush();
+	if (!allErrors.empty()) {
+		return mkStdStringError(allErrors);
+	}
+	return lean_io_result_mk_ok(lean_box(numChecked));
+}
+
+// Verify only the function definitions of the given module
+// that changed since they last verified successfully with the given cache.
+// Unlike `papyrus_module_verify`, this does not check module-level
+// invariants (e.g., of global variables or cross-function debug info).
+extern "C" lean_obj_res papyrus_module_verify_incremental
+	(b_lean_obj_res modRef, b_lean_obj_res cacheObj, uint32_t numThreads,
+		lean_obj_arg /* w */)
+{
+	return verifyIncremental(*toModule(modRef),
+		*fromOwnedPtr<VerifierCache>(cacheObj), numThreads);
+}
+
+} // end namespace papyrus
@@ -112,6 +112,363 @@ def testHelloWorldProgram : LlvmM PUnit := do
       throw <| IO.userError s!"program exited with code {out.exitCode}"
     assertBEq hello out.stdout
 
+--------------------------------------------------------------------------------
+-- # Shared JIT Functions
+--------------------------------------------------------------------------------
+
+def mkSharedModule (name : String) : LlvmM (ModuleRef × FunctionRef) := do
+    let mod ← ModuleRef.new name
+    let intTypeRef ← IntegerTypeRef.get 32
+    let fnTy ← FunctionTypeRef.get intTypeRef #[]
+
+    -- A self-contained helper (shareable between engines)
+    let helper ← FunctionRef.create fnTy "seven"
+    mod.appendFunction helper
+    let bb ← BasicBlockRef.create
+    helper.appendBasicBlock bb
+    bb.appendInstruction <| ← ReturnInstRef.create (← intTypeRef.getConstantInt 7)
+
+    -- A main function calling it
+    let main ← FunctionRef.create fnTy "main"
+    mod.appendFunction main
+    let bb ← BasicBlockRef.create
+    main.appendBasicBlock bb
+    let call ← helper.createCall #[]
+    bb.appendInstruction call
+    bb.appendInstruction <| ← ReturnInstRef.create call
+    discard mod.verify
+    return (mod, main)
+
+def testSharedFunctions : LlvmM PUnit := do
+    let (mod1, main1) ← mkSharedModule "shared1"
+    let ee1 ← ExecutionEngineRef.createForModule mod1 (shareFunctions := true)
+    assertBEq 7 (← (← ee1.runFunction main1).toInt)
+    let (mod2, main2) ← mkSharedModule "shared2"
+    let ee2 ← ExecutionEngineRef.createForModule mod2 (shareFunctions := true)
+    assertBEq 1 (← ee2.getNumReusedFunctions)
+    assertBEq 7 (← (← ee2.runFunction main2).toInt)
+    -- the reused definitions are only declarations in the engine's copy
+    discard mod2.verify
+    assertBEq 1 (← (← mod2.getFunction "seven").getBasicBlocks).size
+    -- keep `ee1` alive past the creation of `ee2`, so that it has code to share
+    assertBEq 7 (← (← ee1.runFunction main1).toInt)
+
+--------------------------------------------------------------------------------
+-- # Multi-Module Engines
+--------------------------------------------------------------------------------
+
+def mkConstantModule (name : String) (fnName : String) (val : Int)
+: LlvmM (ModuleRef × FunctionRef) := do
+    let mod ← ModuleRef.new name
+    let intTypeRef ← IntegerTypeRef.get 32
+    let fn ← FunctionRef.create (← FunctionTypeRef.get intTypeRef #[]) fnName
+    mod.appendFunction fn
+    let bb ← BasicBlockRef.create
+    fn.appendBasicBlock bb
+    bb.appendInstruction <| ← ReturnInstRef.create (← intTypeRef.getConstantInt val)
+    discard mod.verify
+    return (mod, fn)
+
+def testMultiModuleEngine : LlvmM PUnit := do
+    let (mod1, one) ← mkConstantModule "one" "one" 1
+    let (mod2, two) ← mkConstantModule "two" "two" 2
+    let ee ← ExecutionEngineRef.createForModule mod1
+    ee.addModule mod2
+    assertBEq 2 (← ee.getNumModules)
+    ee.finalizeObject
+    assertBEq 1 (← (← ee.runFunction one).toInt)
+    assertBEq 2 (← (← ee.runFunction two).toInt)
+    -- Redefine `two` (only its module is recompiled)
+    let (mod3, two') ← mkConstantModule "two'" "two" 22
+    ee.replaceModule mod2 mod3
+    assertBEq 22 (← (← ee.runFunction two').toInt)
+    assertBEq 1 (← (← ee.runFunction one).toInt)
+    ee.removeModule mod3
+    assertBEq 1 (← ee.getNumModules)
+
+--------------------------------------------------------------------------------
+-- # Tiered Execution
+--------------------------------------------------------------------------------
+
+def testTieredEngine : LlvmM PUnit := do
+    let (mod, fn) ← mkConstantModule "tiered" "answer" 42
+    let te ← TieredEngineRef.create mod (threshold := 2)
+    assertBEq 42 (← (← te.runFunction fn).toInt)
+    assertBEq false (← te.isOptimized)
+    assertBEq 42 (← (← te.runFunction fn).toInt)
+    te.wait
+    assertBEq true (← te.isOptimized)
+    assertBEq 42 (← (← te.runFunction fn).toInt)
+    assertBEq 2 (← te.getCallCount fn)
+
+/-- A module whose `bump` increments an internal counter and returns it. -/
+def mkCounterModule (name : String) : LlvmM (ModuleRef × FunctionRef) := do
+    let mod ← ModuleRef.new name
+    let intTypeRef ← IntegerTypeRef.get 32
+    let counter ← GlobalVariableRef.newWithInit intTypeRef
+      (linkage := Linkage.internal) (init := ← intTypeRef.getConstantInt 0) (name := "counter")
+    mod.appendGlobalVariable counter
+    let fn ← FunctionRef.create (← FunctionTypeRef.get intTypeRef #[]) "bump"
+    mod.appendFunction fn
+    let bb ← BasicBlockRef.create
+    fn.appendBasicBlock bb
+    let val ← LoadInstRef.create intTypeRef counter
+    bb.appendInstruction val
+    let next ← BinaryOperatorRef.create InstructionKind.add val (← intTypeRef.getConstantInt 1)
+    bb.appendInstruction next
+    bb.appendInstruction <| ← StoreInstRef.create next counter
+    bb.appendInstruction <| ← ReturnInstRef.create next
+    discard mod.verify
+    return (mod, fn)
+
+def testTieredGlobals : LlvmM PUnit := do
+    let (mod, bump) ← mkCounterModule "tiered-counter"
+    let te ← TieredEngineRef.create mod (threshold := 2)
+    assertBEq 1 (← (← te.runFunction bump).toInt)
+    assertBEq 2 (← (← te.runFunction bump).toInt)
+    te.wait
+    assertBEq true (← te.isOptimized)
+    -- the optimized tier continues from the base tier's state
+    assertBEq 3 (← (← te.runFunction bump).toInt)
+    assertBEq 4 (← (← te.runFunction bump).toInt)
+
+--------------------------------------------------------------------------------
+-- # Profile-Guided Optimization
+--------------------------------------------------------------------------------
+
+def testProfileGuidedOptimization : LlvmM PUnit := do
+    let (mod, _) ← mkConstantModule "pgo" "answer" 42
+    let (instrumented, profile) ← ProfileRef.instrument mod
+    let fn ← instrumented.getFunction "answer"
+    let ee ← ExecutionEngineRef.createForModule instrumented
+    for _ in [0:3] do
+      assertBEq 42 (← (← ee.runFunction fn).toInt)
+    profile.collect ee
+    assertBEq 3 (← profile.getEntryCount "answer")
+    assertBEq 1 (← profile.apply mod)
+    mod.optimize OptLevel.aggressive
+    discard mod.verify
+
+--------------------------------------------------------------------------------
+-- # Linking
+--------------------------------------------------------------------------------
+
+/-- A module whose `main` calls an external `seven`. -/
+def mkCallerModule (name : String) : LlvmM (ModuleRef × FunctionRef) := do
+    let mod ← ModuleRef.new name
+    let intTypeRef ← IntegerTypeRef.get 32
+    let fnTy ← FunctionTypeRef.get intTypeRef #[]
+    let seven ← FunctionRef.create fnTy "seven"
+    mod.appendFunction seven
+    let main ← FunctionRef.create fnTy "main"
+    mod.appendFunction main
+    let bb ← BasicBlockRef.create
+    main.appendBasicBlock bb
+    let call ← seven.createCall #[]
+    bb.appendInstruction call
+    bb.appendInstruction <| ← ReturnInstRef.create call
+    return (mod, main)
+
+def testLinking : LlvmM PUnit := do
+    let (prelude, _) ← mkConstantModule "prelude" "seven" 7
+    prelude.link (← mkConstantModule "unused" "unused" 0).1
+    assertBEq 2 (← prelude.getFunctions).size
+    -- Lazy linking only pulls in `seven`
+    let (lazyMod, _) ← mkCallerModule "lazy"
+    lazyMod.link prelude (lazy := true)
+    assertBEq 2 (← lazyMod.getFunctions).size
+    -- Internalizing strips the unreachable `unused`
+    let (mod, main) ← mkCallerModule "linked"
+    mod.link prelude
+    assertBEq 1 (← mod.internalize #["main"])
+    discard mod.verify
+    let ee ← ExecutionEngineRef.createForModule mod
+    assertBEq 7 (← (← ee.runFunction main).toInt)
+
+--------------------------------------------------------------------------------
+-- # Specialization
+--------------------------------------------------------------------------------
+
+def testSpecialization : LlvmM PUnit := do
+    let mod ← ModuleRef.new "specialize"
+    let i1 ← IntegerTypeRef.get 1
+    let i32 ← IntegerTypeRef.get 32
+    -- `choose c x = if c then x else 0`
+    let fn ← FunctionRef.create (← FunctionTypeRef.get i32 #[i1, i32]) "choose"
+    mod.appendFunction fn
+    let entry ← BasicBlockRef.create
+    let bbThen ← BasicBlockRef.create
+    let bbElse ← BasicBlockRef.create
+    fn.appendBasicBlock entry
+    fn.appendBasicBlock bbThen
+    fn.appendBasicBlock bbElse
+    entry.appendInstruction <| ← CondBrInstRef.create bbThen bbElse (← fn.getArg 0)
+    bbThen.appendInstruction <| ← ReturnInstRef.create (← fn.getArg 1)
+    bbElse.appendInstruction <| ← ReturnInstRef.create (← i32.getConstantInt 0)
+    discard mod.verify
+    let true' : ConstantRef ← i1.getConstantInt 1
+    let spec ← fn.specialize #[some true']
+    assertBEq 1 (← spec.getBasicBlocks).size
+    -- Specializations are cached per argument tuple
+    assertBEq (← spec.getName) (← (← fn.specialize #[some true', none]).getName)
+    -- ... and per simplification
+    let raw ← fn.specialize #[some true'] (simplify := false)
+    assertBEq 3 (← raw.getBasicBlocks).size
+    discard mod.verify
+    let ee ← ExecutionEngineRef.createForModule mod EngineKind.interpreter
+    assertBEq 5 (← (← ee.runFunction spec #[← GenericValueRef.ofInt 32 5]).toInt)
+
+--------------------------------------------------------------------------------
+-- # Inlining
+--------------------------------------------------------------------------------
+
+def testInlining : LlvmM PUnit := do
+    let (prelude, _) ← mkConstantModule "prelude" "seven" 7
+    -- Inlining a specific call site
+    let (mod, main) ← mkCallerModule "inline"
+    mod.link prelude
+    let bb := (← main.getBasicBlocks)[0]
+    let inst := (← bb.getInstructions)[0]
+    if h : inst.instructionKind = InstructionKind.call then
+      let call := CallInstRef.castInst inst h
+      assertBEq true (← call.getInlineCost).isFavorable
+      call.inlineCallee
+    else
+      throw <| IO.userError "expected a call to `seven`"
+    assertBEq 1 (← bb.getInstructions).size
+    discard mod.verify
+    let ee ← ExecutionEngineRef.createForModule mod EngineKind.interpreter
+    assertBEq 7 (← (← ee.runFunction main).toInt)
+    -- Inlining a whole module bottom-up
+    let (mod, main) ← mkCallerModule "inlineAll"
+    mod.link prelude
+    let seven ← mod.getFunction "seven"
+    seven.setLinkage Linkage.internal
+    assertBEq 1 (← mod.inlineCalls)
+    assertBEq 1 (← (← main.getBasicBlocks)[0].getInstructions).size
+    discard mod.verify
+    -- Unused internal functions are only deleted on request
+    assertBEq true (← mod.getFunction? "seven").isSome
+    discard <| mod.inlineCalls (removeDead := true)
+    assertBEq false (← mod.getFunction? "seven").isSome
+
+--------------------------------------------------------------------------------
+-- # Optimization Remarks
+--------------------------------------------------------------------------------
+
+def testRemarks : LlvmM PUnit := do
+    let (prelude, _) ← mkConstantModule "prelude" "seven" 7
+    let (mod, _) ← mkCallerModule "remarks"
+    mod.link prelude
+    IO.FS.createDirAll testOutDir
+    let file := testOutDir / "remarks.yaml"
+    let ((), remarks) ← withRemarks (mod.optimize) (passes := "inline") (file := file)
+    let some inlined ← remarks.find? (·.name == "Inlined")
+      | throw <| IO.userError s!"no inlining remark in {repr remarks}"
+    assertBEq RemarkKind.passed inlined.kind
+    assertBEq "main" inlined.function
+    assertBEq (some "seven") (inlined.getArg? "Callee")
+    unless remarks.all (·.passName == "inline") do
+      throw <| IO.userError "remarks of other passes were collected"
+    unless (← IO.FS.readFile file).length > 0 do
+      throw <| IO.userError "remark file is empty"
+
+--------------------------------------------------------------------------------
+-- # Target Cost Model
+--------------------------------------------------------------------------------
+
+def testTargetCostModel : LlvmM PUnit := do
+    let tm ← TargetMachineRef.createHost
+    let info ← tm.getInfo
+    unless info.vectorRegisterBits > 0 && info.numVectorRegisters > 0 do
+      throw <| IO.userError s!"host has no vector registers: {repr info}"
+    let i32 ← IntegerTypeRef.get 32
+    assertBEq true (← tm.isTypeLegal i32)
+    let lengths ← tm.getLegalVectorLengths i32
+    assertBEq true (lengths.contains (info.vectorRegisterBits / 32))
+    let double ← DoubleTypeRef.get
+    let cost ← tm.getIntrinsicCost "llvm.sqrt.f64" double #[double]
+    assertBEq true cost.isSome
+
+--------------------------------------------------------------------------------
+-- # Data Layout
+--------------------------------------------------------------------------------
+
+def testDataLayout : LlvmM PUnit := do
+    let mod ← ModuleRef.new "layout"
+    mod.setHostTarget
+    assertBEq false (← mod.getDataLayout).isEmpty
+    let i8 ← IntegerTypeRef.get 8
+    let i32 ← IntegerTypeRef.get 32
+    let i64 ← IntegerTypeRef.get 64
+    let struct ← LiteralStructTypeRef.get #[i8, i32, i64]
+    let layouts ← mod.getTypeLayouts #[i8, i32, (struct : TypeRef)]
+    assertBEq #[1, 4, 16] (layouts.map (·.allocSize))
+    assertBEq #[8, 32, 128] (layouts.map (·.sizeInBits))
+    let structLayouts ← mod.getStructLayouts #[(struct : TypeRef)]
+    assertBEq #[0, 4, 8] structLayouts[0].fieldOffsets
+    assertBEq 16 structLayouts[0].size
+
+--------------------------------------------------------------------------------
+-- # Disassembly
+--------------------------------------------------------------------------------
+
+def testDisassembly : LlvmM PUnit := do
+    let (mod, fn) ← mkConstantModule "disasm" "answer" 42
+    let ee ← ExecutionEngineRef.createForModule mod EngineKind.jit
+    let code ← ee.disassemble fn
+    assertBEq code.size (← ee.getCodeSize fn)
+    assertBEq code.size (code.instructions.foldl (· + ·.size) 0)
+    unless code.instructions.any (·.text.startsWith "ret") do
+      throw <| IO.userError s!"no return in disassembly: {repr code}"
+    -- A call to a helper is listed once the code is relocated
+    let (mod, main) ← mkSharedModule "disasm-call"
+    let ee ← ExecutionEngineRef.createForModule mod EngineKind.jit
+    let code ← ee.disassemble main
+    unless code.instructions.any (·.text.startsWith "call") do
+      throw <| IO.userError s!"no call in disassembly: {repr code}"
+    assertBEq 7 (← (← ee.runFunction main).toInt)
+
+--------------------------------------------------------------------------------
+-- # Throughput Analysis
+--------------------------------------------------------------------------------
+
+def testThroughputAnalysis : LlvmM PUnit := do
+    let (mod, fn) ← mkConstantModule "mca" "answer" 42
+    let cpu ← (← TargetMachineRef.createHost).getCPU
+    let ee ← ExecutionEngineRef.createForModule mod EngineKind.jit (mcpu := cpu)
+    let report ← ee.analyzeThroughput fn (iterations := 10)
+    assertBEq 10 report.iterations
+    unless report.numInstructions > 0 && report.totalCycles > 0 do
+      throw <| IO.userError s!"empty throughput report: {repr report}"
+    -- Only the first instruction (the `ret` is excluded)
+    let first ← ee.analyzeThroughput fn (iterations := 10) (count := 1)
+    assertBEq 1 first.numInstructions
+
+--------------------------------------------------------------------------------
+-- # JIT Session
+--------------------------------------------------------------------------------
+
+def testJitSession : IO PUnit := do
+    JitSession.clear
+    -- Identical modules built in separate contexts are compiled once
+    for _ in [0:2] do
+      LlvmM.run do
+        let (mod, _) ← mkConstantModule "session" "main" 5
+        assertBEq 5 (← JitSession.runMain mod)
+    assertBEq 1 (← JitSession.getNumModules)
+    LlvmM.run do
+      let (mod, _) ← mkConstantModule "session" "main" 6
+      assertBEq 6 (← JitSession.runMain mod)
+    assertBEq 2 (← JitSession.getNumModules)
+    -- Each run starts from the initial values of the module's globals
+    LlvmM.run do
+      let (mod, bump) ← mkCounterModule "session-counter"
+      bump.setName "main"
+      assertBEq 1 (← JitSession.runMain mod)
+      assertBEq 1 (← JitSession.runMain mod)
+    assertBEq 3 (← JitSession.getNumModules)
+
 --------------------------------------------------------------------------------
 -- # Runner
 --------------------------------------------------------------------------------
@@ -121,9 +478,39 @@ def main : IO PUnit := do
     throw <| IO.userError "failed to initialize native target"
   if (← initNativeAsmPrinter) then
     throw <| IO.userError "failed to initialize native asm printer"
+  if (← initNativeDisassembler) then
+    throw <| IO.userError "failed to initialize native disassembler"
 
   LlvmM.run do
     IO.println "Testing exiting program ... "
     testSimpleExitingProgram
     IO.println "Testing hello world program ... "
     testHelloWorldProgram
+    IO.println "Testing shared JIT functions ... "
+    testSharedFunctions
+    IO.println "Testing multi-module engine ... "
+    testMultiModuleEngine
+    IO.println "Testing tiered engine ... "
+    testTieredEngine
+    IO.println "Testing tiered engine globals ... "
+    testTieredGlobals
+    IO.println "Testing profile-guided optimization ... "
+    testProfileGuidedOptimization
+    IO.println "Testing linking ... "
+    testLinking
+    IO.println "Testing specialization ... "
+    testSpecialization
+    IO.println "Testing inlining ... "
+    testInlining
+    IO.println "Testing optimization remarks ... "
+    testRemarks
+    IO.println "Testing target cost model ... "
+    testTargetCostModel
+    IO.println "Testing data layout ... "
+    testDataLayout
+    IO.println "Testing disassembly ... "
+    testDisassembly
+    IO.println "Testing throughput analysis ... "
+    testThroughputAnalysis
+  IO.println "Testing JIT session ... "
+  testJitSession
@@ -14,6 +14,12 @@ llvm module echo do
 
 #jit echo #["a", "b", "c"]
 
+llvm bitcode module precompiled do
+  define i32 @main() do
+   ret i32 7
+
+#jit precompiled
+
 llvm module empty do
   pure ()
 
@@ -0,0 +1,27 @@
+import Papyrus
+
+open Papyrus
+
+def assertBEq [Repr α] [BEq α] (expected actual : α) : IO PUnit := do
+  unless expected == actual do
+    throw <| IO.userError s!"expected '{repr expected}', got '{repr actual}'"
+
+-- phase counts
+#eval LlvmM.run do
+  Instrumentation.enable (timePasses := false) (collectStatistics := false)
+  Instrumentation.reset
+  let mod ← Builder.module "test" (pure ())
+  discard mod.verify
+  discard mod.verify
+  discard mod.sprint
+  withPhase Phase.construct (pure ())
+  Instrumentation.disable
+  discard mod.verify
+  let report ← Instrumentation.getReport
+  for (phase, timing) in report.phases do
+    let expected : UInt64 := match phase with
+      | Phase.construct => 2
+      | Phase.verify => 2
+      | Phase.print => 1
+      | _ => 0
+    assertBEq expected timing.count
@@ -81,3 +81,35 @@ def assertBEq [Repr α] [BEq α] (expected actual : α) : IO PUnit := do
   let pti ← ConstantExprRef.getPtrToInt itp ity
   assertBEq TypeID.pointer (← (← itp.getType).typeID)
   assertBEq TypeID.integer (← (← pti.getType).typeID)
+
+-- constant data array from raw bytes
+#eval LlvmM.run do
+  let bytes := ByteArray.mk #[1, 2, 3, 4, 5, 6, 7, 8]
+  let const ← ConstantDataSequentialRef.ofBytes bytes (← IntegerTypeRef.get 16)
+  let ⟨h⟩ ← assertEq ValueKind.constantDataArray const.valueKind
+  let const := ConstantDataArrayRef.cast const h.symm
+  assertBEq 4 (← const.getNumElements)
+  assertBEq bytes.data (← const.getRawData).data
+  -- all-zero data is uniqued to a zero aggregate
+  let zeros := ByteArray.mk #[0, 0, 0, 0]
+  let zero ← ConstantDataSequentialRef.ofBytes zeros (← IntegerTypeRef.get 16)
+  assertBEq ValueKind.constantAggregateZero zero.valueKind
+  let zero : ConstantDataSequentialRef := ⟨⟨zero⟩⟩
+  assertBEq 2 (← zero.getNumElements)
+  assertBEq zeros.data (← zero.getRawData).data
+
+-- constant data vector from words
+#eval LlvmM.run do
+  let const ← ConstantDataSequentialRef.ofUInt32Array #[1, 2, 3] (isVector := true)
+  assertBEq ValueKind.constantDataVector const.valueKind
+
+-- batched big integer constants
+#eval LlvmM.run do
+  let vals : Array Int := #[2 ^ 100 + 7, -(2 ^ 90), 5]
+  let int128TypeRef ← IntegerTypeRef.get 128
+  let consts ← int128TypeRef.getConstantInts vals
+  for (val, const) in vals.zip consts do
+    assertBEq val (← const.getIntValue)
+  let nats ← int128TypeRef.getConstantNats #[2 ^ 127]
+  for const in nats do
+    assertBEq (2 ^ 127) (← const.getNatValue)
@@ -29,3 +29,36 @@ def assertBEq [Repr α] [BEq α] (expected actual : α) : IO PUnit := do
     assertBEq fnName (← fn.getName)
   else
     throw <| IO.userError s!"expected 1 function in module, got {fns.size}"
+
+-- streaming and per-function printing
+#eval LlvmM.run do
+  let i32 ← IntegerTypeRef.get 32
+  let fnTy ← FunctionTypeRef.get i32 #[]
+  let mod ← module "test" do
+    discard <| declare fnTy "foo"
+    discard <| define fnTy (name := "main") do
+      ret (← ConstantIntRef.ofUInt32 0)
+  let file : System.FilePath := "moduleRef.print.ll"
+  mod.printToFile file
+  assertBEq (← mod.sprint) (← IO.FS.readFile file)
+  IO.FS.removeFile file
+  let fns ← mod.sprintFunctions
+  assertBEq 1 fns.size
+  assertBEq "define i32 @main() {\n  ret i32 0\n}\n" fns[0]
+
+-- incremental verification
+#eval LlvmM.run do
+  let i32 ← IntegerTypeRef.get 32
+  let fnTy ← FunctionTypeRef.get i32 #[]
+  let mod ← module "test" do
+    discard <| define fnTy (name := "foo") do
+      ret (← ConstantIntRef.ofUInt32 0)
+    discard <| define fnTy (name := "bar") do
+      ret (← ConstantIntRef.ofUInt32 1)
+  let cache ← VerifierCacheRef.new
+  assertBEq 2 (← mod.verifyIncremental cache)
+  assertBEq 0 (← mod.verifyIncremental cache (numThreads := 1))
+  match (← mod.getFunctions).get? 0 with
+  | some fn => cache.invalidate fn
+  | none => throw <| IO.userError "expected a function in module"
+  assertBEq 1 (← mod.verifyIncremental cache)
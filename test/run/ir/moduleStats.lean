@@ -0,0 +1,33 @@
+import Papyrus
+
+open Papyrus Builder
+
+def assertBEq [Repr α] [BEq α] (expected actual : α) : IO PUnit := do
+  unless expected == actual do
+    throw <| IO.userError s!"expected '{repr expected}', got '{repr actual}'"
+
+-- module sizes
+#eval LlvmM.run do
+  let i32 ← IntegerTypeRef.get 32
+  let fnTy ← FunctionTypeRef.get i32 #[]
+  let mod ← module "test" do
+    discard <| declare fnTy "foo"
+    discard <| define fnTy (name := "main") do
+      ret (← ConstantIntRef.ofUInt32 0)
+  let stats ← mod.getStats
+  assertBEq 2 stats.functions
+  assertBEq 0 stats.globalVariables
+  assertBEq 1 stats.basicBlocks
+  assertBEq 1 stats.instructions
+
+-- live object counts
+#eval LlvmM.run do
+  let mod ← ModuleRef.new "test"
+  let counts ← Counters.getObjectCounts
+  match counts.get? 3 with
+  | some count =>
+    if count.live == 0 || count.allocated < count.live then
+      throw <| IO.userError s!"bad module count {repr count}"
+  | none => throw <| IO.userError "missing module count"
+  let snapshot ← Counters.snapshot #[mod]
+  assertBEq 1 snapshot.modules.size
@@ -0,0 +1,98 @@
+import Papyrus
+
+open Papyrus
+
+def assertBEq [Repr α] [BEq α] (expected actual : α) : IO PUnit := do
+  unless expected == actual do
+    throw <| IO.userError s!"expected '{repr expected}', got '{repr actual}'"
+
+-- in-place mutation of `f(x, y, p) { store x, p; ret x }`
+#eval LlvmM.run do
+  let mod ← ModuleRef.new "mutation"
+  let i32 ← IntegerTypeRef.get 32
+  let fnTy ← FunctionTypeRef.get i32 #[i32, i32, ← PointerTypeRef.get i32]
+  let fn ← FunctionRef.create fnTy "f"
+  mod.appendFunction fn
+  let bb ← BasicBlockRef.create "entry"
+  fn.appendBasicBlock bb
+  let x ← fn.getArg 0
+  let y ← fn.getArg 1
+  let p ← fn.getArg 2
+  let store ← StoreInstRef.create x p
+  bb.appendInstruction store
+  let ret ← ReturnInstRef.create x
+  bb.appendInstruction ret
+
+  -- Uses and operands
+  assertBEq 2 (← x.getUsers).size
+  x.replaceAllUsesWith y
+  assertBEq 0 (← x.getNumUses)
+  assertBEq 2 (← y.getNumUses)
+  ret.setOperand 0 x
+  assertBEq 1 (← x.getNumUses)
+  assertBEq 1 (← ret.getNumOperands)
+  assertBEq 2 (← store.getNumOperands)
+
+  -- Splitting
+  let tail ← bb.split ret "exit"
+  assertBEq 2 (← fn.getBasicBlocks).size
+  assertBEq 2 (← bb.getInstructions).size
+  let some br ← bb.getTerminator? | throw <| IO.userError "split block has no terminator"
+  assertBEq InstructionKind.branch br.instructionKind
+
+  -- Moving and erasing
+  store.moveAfter br
+  store.moveBefore br
+  let dead ← StoreInstRef.create y p
+  dead.moveBefore br
+  assertBEq 3 (← bb.getInstructions).size
+  dead.eraseFromParent
+  assertBEq 2 (← bb.getInstructions).size
+  let some parent ← ret.getParent? | throw <| IO.userError "instruction has no parent"
+  assertBEq (← tail.getName) (← parent.getName)
+  let deadBB ← BasicBlockRef.create "dead"
+  deadBB.moveAfter tail
+  deadBB.appendInstruction (← ReturnInstRef.create y)
+  assertBEq 3 (← fn.getBasicBlocks).size
+  deadBB.eraseFromParent
+  assertBEq 2 (← fn.getBasicBlocks).size
+  fn.verify
+
+-- erasing a predecessor of a PHI (made by inlining a call of `pick c = if c then 1 else 2`)
+#eval LlvmM.run do
+  let mod ← ModuleRef.new "phi"
+  let i1 ← IntegerTypeRef.get 1
+  let i32 ← IntegerTypeRef.get 32
+  let fnTy ← FunctionTypeRef.get i32 #[i1]
+  let pick ← FunctionRef.create fnTy "pick"
+  mod.appendFunction pick
+  let entry ← BasicBlockRef.create "entry"
+  let bbOne ← BasicBlockRef.create "one"
+  let bbTwo ← BasicBlockRef.create "two"
+  pick.appendBasicBlock entry
+  pick.appendBasicBlock bbOne
+  pick.appendBasicBlock bbTwo
+  entry.appendInstruction <| ← CondBrInstRef.create bbOne bbTwo (← pick.getArg 0)
+  bbOne.appendInstruction <| ← ReturnInstRef.create (← i32.getConstantInt 1)
+  bbTwo.appendInstruction <| ← ReturnInstRef.create (← i32.getConstantInt 2)
+  let fn ← FunctionRef.create fnTy "f"
+  mod.appendFunction fn
+  let bb ← BasicBlockRef.create "entry"
+  fn.appendBasicBlock bb
+  let call ← pick.createCall #[← fn.getArg 0]
+  bb.appendInstruction call
+  bb.appendInstruction <| ← ReturnInstRef.create call
+  call.inlineCallee
+
+  -- `f` is now `entry -> one | two -> exit` with a PHI of both in `exit`
+  let bbs ← fn.getBasicBlocks
+  assertBEq 4 bbs.size
+  let phi := (← bbs[3].getInstructions)[0]
+  assertBEq 2 (← phi.getNumOperands)
+  -- Jump straight to `one`, leaving `two` unused
+  let some br ← bb.getTerminator? | throw <| IO.userError "inlined block has no terminator"
+  br.eraseFromParent
+  bb.appendInstruction <| ← BrInstRef.create bbs[1]
+  bbs[2].eraseFromParent
+  assertBEq 1 (← phi.getNumOperands)
+  fn.verify
@@ -0,0 +1,83 @@
+import Papyrus
+
+open Papyrus Script
+
+def assertBEq [Repr α] [BEq α] (expected actual : α) : IO PUnit := do
+  unless expected == actual do
+    throw <| IO.userError s!"expected '{repr expected}', got '{repr actual}'"
+
+llvm rewrite mulByTwo : mul %x, 2 => shl %x, 1
+llvm rewrite addZero : add %x, 0 => %x
+llvm rewrite subSelf : sub %x, %x => 0
+llvm rewrite addWide : add %x, 256 => %x
+llvm rewrite subSelfWide : sub %x, %x => 256
+
+-- rewriting `f(x) = ((x * 2) + 0) + ((0 + x) - x)` to `f(x) = x << 1`
+#eval LlvmM.run do
+  let mod ← ModuleRef.new "rewrite"
+  let i32 ← IntegerTypeRef.get 32
+  let fn ← FunctionRef.create (← FunctionTypeRef.get i32 #[i32]) "f"
+  mod.appendFunction fn
+  let bb ← BasicBlockRef.create "entry"
+  fn.appendBasicBlock bb
+  let x ← fn.getArg 0
+  let two ← ConstantIntRef.ofNat 32 2
+  let zero ← ConstantIntRef.ofNat 32 0
+  let mk kind (lhs rhs : ValueRef) : IO BinaryOperatorRef := do
+    let op ← BinaryOperatorRef.create kind lhs rhs
+    bb.appendInstruction op
+    pure op
+  let lhs ← mk InstructionKind.add (← mk InstructionKind.mul x two) zero
+  let rhs ← mk InstructionKind.sub (← mk InstructionKind.add zero x) x
+  let sum ← mk InstructionKind.add lhs rhs
+  bb.appendInstruction <| ← ReturnInstRef.create sum
+
+  let rules ← RewriteRulesRef.compile #[mulByTwo, addZero, subSelf]
+  assertBEq 3 (← rules.getSize)
+  assertBEq #[1, 3, 1] (← fn.rewrite rules)
+  assertBEq 2 (← bb.getInstructions).size
+  fn.verify
+
+  -- replacements may only use variables bound by their pattern
+  let bad : RewriteRule := {
+    name := "bad"
+    pattern := Pattern.inst InstructionKind.add #[Pattern.var 0, Pattern.int 0]
+    replacement := Replacement.var 1
+  }
+  let compiled ← (do discard <| RewriteRulesRef.compile #[bad]; pure true) <|> pure false
+  assertBEq false compiled
+
+  -- rules may not match PHIs
+  let phi : RewriteRule := {
+    name := "phi"
+    pattern := Pattern.inst InstructionKind.phi #[Pattern.var 0]
+    replacement := Replacement.var 0
+  }
+  let compiled ← (do discard <| RewriteRulesRef.compile #[phi]; pure true) <|> pure false
+  assertBEq false compiled
+  let nestedPhi : RewriteRule := {
+    name := "nestedPhi"
+    pattern := Pattern.inst InstructionKind.add
+      #[Pattern.inst InstructionKind.phi #[Pattern.var 0, Pattern.var 1], Pattern.var 2]
+    replacement := Replacement.var 0
+  }
+  let compiled ← (do discard <| RewriteRulesRef.compile #[nestedPhi]; pure true) <|> pure false
+  assertBEq false compiled
+
+-- integer constants only match and replace values of types they fit in
+#eval LlvmM.run do
+  let mod ← ModuleRef.new "rewriteWidth"
+  let i8 ← IntegerTypeRef.get 8
+  let fn ← FunctionRef.create (← FunctionTypeRef.get i8 #[i8]) "g"
+  mod.appendFunction fn
+  let bb ← BasicBlockRef.create "entry"
+  fn.appendBasicBlock bb
+  let x ← fn.getArg 0
+  let add ← BinaryOperatorRef.create InstructionKind.add x (← ConstantIntRef.ofNat 8 0)
+  bb.appendInstruction add
+  let sub ← BinaryOperatorRef.create InstructionKind.sub add add
+  bb.appendInstruction sub
+  bb.appendInstruction <| ← ReturnInstRef.create sub
+  let rules ← RewriteRulesRef.compile #[addWide, subSelfWide]
+  assertBEq #[0, 0] (← fn.rewrite rules)
+  assertBEq 3 (← bb.getInstructions).size
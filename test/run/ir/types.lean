@@ -37,3 +37,14 @@ macro tk:"#check_type" x:term : command => do
 #check_type vectorType int32Type 4 true
 #check_type fixedVectorType doubleType 8
 #check_type scalableVectorType int1Type 16
+
+-- batch (and memoized) lowering
+#eval LlvmM.run do
+  let fnTy : «Type» := functionType int32Type #[int8Type.pointerType, doubleType]
+  let types : Array «Type» := #[fnTy, int32Type, fnTy, opaqueStructType "bar"]
+  let refs ← Type.getRefs types
+  unless refs.size == types.size do
+    throw <| IO.userError s!"expected {types.size} types, got {refs.size}"
+  for (type, ref) in types.zip refs do
+    unless type == (← ref.purify) do
+      throw <| IO.userError s!"batch lowering of {repr type} did not round trip"